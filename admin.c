@@ -0,0 +1,102 @@
+/*
+ * admin.c - /metrics 등을 내보내는 관리용 HTTP 서버
+ *
+ * 요청 경로와 섞이지 않도록 별도 포트와 스레드를 쓴다. 핸들러는
+ * open_memstream으로 본문을 다 만든 뒤 길이를 알고 한 번에 보낸다.
+ */
+#include "admin.h"
+
+#define ADMIN_MAX_ROUTES 8
+#define ADMIN_TIMEOUT_S  1      /* 요청을 늦게 보내는 클라이언트는 끊음 */
+
+typedef struct {
+    const char *path;
+    const char *content_type;
+    admin_handler_t fn;
+} admin_route_t;
+
+static admin_route_t routes[ADMIN_MAX_ROUTES];
+static int nroutes;
+
+void admin_route(const char *path, const char *content_type, admin_handler_t fn)
+{
+    if (nroutes == ADMIN_MAX_ROUTES)
+        app_error("admin_route: too many routes");
+    routes[nroutes].path = path;
+    routes[nroutes].content_type = content_type;
+    routes[nroutes].fn = fn;
+    nroutes++;
+}
+
+static void admin_reply(int fd, const char *status, const char *type,
+                        const char *body, size_t len)
+{
+    char hdr[MAXLINE];
+    int n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\nContent-Type: %s\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+
+    if (rio_writen(fd, hdr, n) >= 0)
+        rio_writen(fd, (void *)body, len);
+}
+
+static void admin_serve(int fd)
+{
+    char buf[MAXLINE], method[16], target[MAXLINE], *query;
+    char *body = NULL;
+    size_t len = 0;
+    rio_t rio;
+    FILE *fp;
+
+    rio_readinitb(&rio, fd);
+    if (rio_readlineb(&rio, buf, MAXLINE) <= 0 ||
+        sscanf(buf, "%15s %8191s", method, target) != 2)
+        return;
+    /* 헤더는 읽고 버림 */
+    while (rio_readlineb(&rio, buf, MAXLINE) > 0 && strcmp(buf, "\r\n"))
+        ;
+    if ((query = strchr(target, '?')))
+        *query++ = '\0';
+    else
+        query = "";
+
+    for (int i = 0; i < nroutes; i++) {
+        if (strcmp(routes[i].path, target))
+            continue;
+        if (!(fp = open_memstream(&body, &len)))
+            return;
+        routes[i].fn(fp, query);
+        fclose(fp);
+        admin_reply(fd, "200 OK", routes[i].content_type, body, len);
+        free(body);
+        return;
+    }
+    admin_reply(fd, "404 Not Found", "text/plain", "not found\n", 10);
+}
+
+static void *admin_thread(void *vargp)
+{
+    int listenfd = (int)(long)vargp, fd;
+    struct timeval tv = { ADMIN_TIMEOUT_S, 0 };
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        if ((fd = accept(listenfd, NULL, NULL)) < 0) {
+            usleep(10000);  /* EMFILE 등에서 돌기만 하지 않게 */
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        admin_serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+void admin_start(char *port)
+{
+    pthread_t tid;
+    int listenfd = Open_listenfd(port);
+
+    Pthread_create(&tid, NULL, admin_thread, (void *)(long)listenfd);
+}
@@ -0,0 +1,21 @@
+#ifndef __ADMIN_H__
+#define __ADMIN_H__
+
+#include "csapp.h"
+
+/*
+ * 관리용 HTTP 포트. 프록시 포트와 따로 열고 스레드 하나가 한 번에 한
+ * 요청씩 처리한다 (스크레이프/디버깅용이라 동시성은 필요 없음).
+ * 응답은 HTTP/1.0 200, Content-Length를 붙이고 바로 닫는다.
+ */
+
+/* 본문을 fp에 쓴다. query는 '?' 뒤 문자열 (없으면 "") */
+typedef void (*admin_handler_t)(FILE *fp, const char *query);
+
+/* path(예: "/metrics")에 핸들러 등록. admin_start 전에 호출 */
+void admin_route(const char *path, const char *content_type, admin_handler_t fn);
+
+/* port에서 듣는 관리 스레드 시작 */
+void admin_start(char *port);
+
+#endif /* __ADMIN_H__ */
@@ -0,0 +1,210 @@
+/*
+ * admit.c - 입장 제어 (load shedding)
+ *
+ *   1. SLO: 워커 풀 큐에 넣으려는 연결의 예상 큐 대기 시간이 slo_ms를
+ *      넘으면 바로 503을 보낸다. 큐에 넣어 봐야 SLO를 못 지킬 요청으로
+ *      큐를 더 막는 대신, 클라이언트가 빨리 재시도/우회하게 한다.
+ *      검사는 accept가 아니라 큐에 넘기는 자리에서 한다 - fast lane이
+ *      큐를 거치지 않고 답하는 캐시 히트까지 503이 되지 않게.
+ *   2. IP별 동시 연결 상한: 한 클라이언트가 워커를 독차지하지 못하게 한다.
+ *   3. EMFILE/ENFILE backoff: fd가 바닥나면 accept가 계속 실패하며 CPU를
+ *      태우므로, 예비 fd로 한 연결을 받아 닫고 지수적으로 쉰다.
+ */
+#include "admit.h"
+#include "stats.h"
+#include "alloc.h"
+#include "trace.h"
+#include <sys/resource.h>
+
+#define IP_BUCKETS     1024
+#define BACKOFF_MIN_US 1000
+#define BACKOFF_MAX_US 100000
+
+/* IP별 열린 연결 수 (연결이 있는 동안만 존재) */
+typedef struct ip_entry {
+    unsigned char addr[16];     /* IPv4는 IPv4-mapped IPv6로 저장 */
+    int count;
+    struct ip_entry *next;
+} ip_entry_t;
+
+static admit_conf_t admit_conf;
+static long (*admit_queue_wait)(void);
+
+static ip_entry_t *ip_table[IP_BUCKETS];
+static pthread_mutex_t ip_lock = PTHREAD_MUTEX_INITIALIZER;
+static ip_entry_t **fd_ip;      /* fd_ip[fd]: 이 연결이 차지한 IP 항목 */
+static int fd_max;
+
+static int spare_fd = -1;       /* EMFILE 때 풀어 쓸 예비 fd */
+static long backoff_us;
+
+static const char shed_response[] =
+    "HTTP/1.0 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "Content-type: text/plain\r\n"
+    "Content-length: 20\r\n\r\n"
+    "Proxy is overloaded\n";
+
+void admit_init(const admit_conf_t *conf, long (*queue_wait_ns)(void))
+{
+    struct rlimit rl;
+
+    admit_conf = *conf;
+    admit_queue_wait = queue_wait_ns;
+    fd_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+             ? rl.rlim_cur : 65536;
+    fd_ip = Calloc(fd_max, sizeof(ip_entry_t *));
+    spare_fd = open("/dev/null", O_RDONLY);
+}
+
+/* 주소를 16바이트 키로 (IPv4 → ::ffff:a.b.c.d) */
+static void ip_key(const struct sockaddr_storage *addr, unsigned char key[16])
+{
+    memset(key, 0, 16);
+    if (addr->ss_family == AF_INET) {
+        key[10] = key[11] = 0xff;
+        memcpy(key + 12, &((struct sockaddr_in *)addr)->sin_addr, 4);
+    } else if (addr->ss_family == AF_INET6) {
+        memcpy(key, &((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+    }
+}
+
+static unsigned ip_hash(const unsigned char key[16])
+{
+    unsigned h = 2166136261u;   /* FNV-1a */
+
+    for (int i = 0; i < 16; i++)
+        h = (h ^ key[i]) * 16777619u;
+    return h % IP_BUCKETS;
+}
+
+/* IP의 연결 수를 하나 늘림. 상한을 넘으면 NULL */
+static ip_entry_t *ip_acquire(const struct sockaddr_storage *addr)
+{
+    unsigned char key[16];
+    ip_entry_t *e;
+
+    ip_key(addr, key);
+    unsigned h = ip_hash(key);
+    pthread_mutex_lock(&ip_lock);
+    for (e = ip_table[h]; e; e = e->next)
+        if (!memcmp(e->addr, key, 16))
+            break;
+    if (!e) {
+        e = Malloc_tag(ALLOC_CONN, sizeof(ip_entry_t));
+        memcpy(e->addr, key, 16);
+        e->count = 0;
+        e->next = ip_table[h];
+        ip_table[h] = e;
+    }
+    if (e->count >= admit_conf.per_ip_max) {
+        e = NULL;               /* 상한 초과 (항목은 열린 연결이 있으니 그대로) */
+    } else {
+        e->count++;
+    }
+    pthread_mutex_unlock(&ip_lock);
+    return e;
+}
+
+static void ip_release(ip_entry_t *e)
+{
+    pthread_mutex_lock(&ip_lock);
+    if (--e->count == 0) {      /* 마지막 연결: 항목 제거 */
+        ip_entry_t **pp = &ip_table[ip_hash(e->addr)];
+        while (*pp != e)
+            pp = &(*pp)->next;
+        *pp = e->next;
+        Free(e);
+    }
+    pthread_mutex_unlock(&ip_lock);
+}
+
+/* 503을 보내고 이미 도착한 요청 바이트를 비운 뒤 닫는다 (RST 방지) */
+static void shed(int connfd)
+{
+    char buf[MAXBUF];
+
+    if (rio_writen(connfd, (void *)shed_response, sizeof(shed_response) - 1) < 0)
+        stats_inc(STAT_CLIENT_WRITE_ERR);
+    shutdown(connfd, SHUT_WR);
+    while (recv(connfd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+    Close(connfd);
+    stats_inc(STAT_CONN_DONE);
+}
+
+int admit_conn(int connfd, const struct sockaddr_storage *addr)
+{
+    if (admit_conf.per_ip_max > 0 && connfd < fd_max) {
+        ip_entry_t *e = ip_acquire(addr);
+        if (!e) {
+            stats_inc(STAT_SHED_IP);
+            shed(connfd);
+            return 0;
+        }
+        fd_ip[connfd] = e;
+    }
+    return 1;
+}
+
+/* 연결이 차지한 IP 항목을 반납 */
+static void ip_put(int connfd)
+{
+    if (connfd < fd_max && fd_ip[connfd]) {
+        ip_entry_t *e = fd_ip[connfd];
+        fd_ip[connfd] = NULL;   /* Close 전에 비워야 재사용된 fd와 안 섞임 */
+        ip_release(e);
+    }
+}
+
+int admit_slo(int connfd)
+{
+    if (admit_conf.slo_ms <= 0 || !admit_queue_wait)
+        return 1;
+    long wait = admit_queue_wait();
+    stats_observe(HIST_ADMIT_WAIT, wait);
+    if (wait <= admit_conf.slo_ms * 1000000L)
+        return 1;
+    stats_inc(STAT_SHED_SLO);
+    ip_put(connfd);
+    trace_ev(connfd, TR_DONE);
+    shed(connfd);
+    return 0;
+}
+
+void admit_close(int connfd)
+{
+    ip_put(connfd);
+    trace_ev(connfd, TR_DONE);
+    Close(connfd);
+    stats_inc(STAT_CONN_DONE);
+}
+
+void admit_accept_error(int listenfd, int err)
+{
+    if (err != EMFILE && err != ENFILE)
+        return;
+
+    /* 예비 fd 자리로 backlog 맨 앞 연결을 받아 바로 닫는다 */
+    if (spare_fd >= 0) {
+        close(spare_fd);
+        int fd = accept(listenfd, NULL, NULL);
+        if (fd >= 0) {
+            close(fd);
+            stats_inc(STAT_SHED_FD);
+        }
+        spare_fd = open("/dev/null", O_RDONLY);
+    }
+
+    backoff_us = backoff_us ? backoff_us * 2 : BACKOFF_MIN_US;
+    if (backoff_us > BACKOFF_MAX_US)
+        backoff_us = BACKOFF_MAX_US;
+    stats_inc(STAT_ACCEPT_BACKOFF);
+    usleep(backoff_us);
+}
+
+void admit_accept_ok(void)
+{
+    backoff_us = 0;
+}
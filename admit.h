@@ -0,0 +1,35 @@
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include "csapp.h"
+
+/* 입장 제어 설정 */
+typedef struct {
+    long slo_ms;          /* 예상 큐 대기 시간이 이보다 길면 503 (0: 끔) */
+    int per_ip_max;       /* 클라이언트 IP당 동시 연결 수 상한 (0: 무제한) */
+} admit_conf_t;
+
+/* queue_wait_ns: 새 연결의 예상 큐 대기 시간 (NULL이면 SLO 검사 안 함) */
+void admit_init(const admit_conf_t *conf, long (*queue_wait_ns)(void));
+
+/* 새 연결을 받을지 결정 (IP별 상한). 거절하면 503을 보내고 닫은 뒤 0 리턴 */
+int admit_conn(int connfd, const struct sockaddr_storage *addr);
+
+/*
+ * 워커 풀 큐에 넣기 직전의 SLO 검사. 예상 대기가 slo_ms를 넘으면
+ * 503을 보내고 닫은 뒤 0 리턴 (fast lane이 답하는 히트는 여기를 안 지남)
+ */
+int admit_slo(int connfd);
+
+/* 처리가 끝난 연결을 닫고 IP별 연결 수를 반납 (모든 연결 종료는 이걸로) */
+void admit_close(int connfd);
+
+/*
+ * accept 실패 처리. EMFILE/ENFILE이면 예비 fd를 풀어 backlog의 연결 하나를
+ * 받아 바로 닫고(클라이언트가 connect 타임아웃 대신 즉시 실패를 보게),
+ * 점점 길게 쉰다. 성공하면 admit_accept_ok로 backoff를 초기화.
+ */
+void admit_accept_error(int listenfd, int err);
+void admit_accept_ok(void);
+
+#endif /* __ADMIT_H__ */
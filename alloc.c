@@ -0,0 +1,385 @@
+/*
+ * alloc.c - 교체 가능한 메모리 할당 계층
+ *
+ * glibc 모드는 malloc/free에 헤더만 붙인다. tcache 모드(-DALLOC_TCACHE)는
+ * 64KB 이하 요청을 스레드별 크기 등급 목록에서 락 없이 처리한다.
+ *
+ *   - 해제는 누가 할당했든 해제하는 스레드의 목록으로 간다. 캐시 노드를
+ *     다른 워커가 퇴출하는 것처럼 스레드를 건너는 해제도 락이 없다.
+ *   - 한 등급 목록이 BIN_MAX_BYTES를 넘으면 슬랩 하나 분량을 한 덩어리로
+ *     등급별 중앙 목록(뮤텍스)에 넘기고, 목록이 비면 중앙 목록에서 그만큼을
+ *     한 번에 가져온다. 스레드를 건너는 블록은 이렇게 묶음으로만 락을 지난다.
+ *   - 중앙 목록도 비면 glibc에서 64KB 슬랩을 받아 잘라 쓴다. 슬랩은 OS에
+ *     돌려주지 않는다 (최대 사용량만큼 남는다).
+ *   - 스레드가 끝나면 (워커 풀 축소) 목록을 모두 중앙 목록에 넘긴다.
+ *
+ * 64KB를 넘는 요청 (캐시 객체, 큰 버퍼)은 두 모드 모두 glibc로 간다.
+ */
+#include "alloc.h"
+
+#define HDR_SIZE      16
+#define NCLASSES      23                /* 32, 48, 64, 96, ... 65536 */
+#define CLS_LARGE     0xffff            /* glibc에서 직접 받은 블록 */
+#define SLAB_BYTES    (64 * 1024)
+#define SLAB_MIN      4                 /* 큰 등급도 슬랩당 최소 블록 수 */
+#define BIN_MAX_BYTES (128 * 1024)      /* 스레드가 한 등급에 쌓아 둘 최대 바이트 */
+
+/* 모든 블록 앞의 헤더 (사용자 포인터가 16바이트 정렬을 유지하도록 16바이트) */
+typedef struct {
+    size_t size;            /* 요청 크기 (통계, realloc용) */
+    unsigned short cls;     /* 크기 등급 또는 CLS_LARGE */
+    unsigned short tag;     /* alloc_tag_t */
+} hdr_t;
+
+/* 빈 블록은 헤더 다음 자리에 다음 블록 포인터를 둔다 */
+#define NEXT(h) (*(hdr_t **)((h) + 1))
+
+/* 스레드마다 하나 (통계 때문에 스레드가 끝나도 남겨 두고 다음 스레드가 씀) */
+typedef struct tstate {
+    hdr_t *bins[NCLASSES];          /* 크기 등급별 빈 블록 (이 스레드만 만짐) */
+    int nbin[NCLASSES];             /* 각 목록의 블록 수 */
+
+    long nalloc[ALLOC_NTAGS];       /* 이 스레드에서 센 통계 (출력할 때 합산) */
+    long nfree[ALLOC_NTAGS];
+    long bytes[ALLOC_NTAGS];
+    long nmoved;                    /* 중앙 목록과 주고받은 블록 수 */
+    long nbatch;                    /* 그 락 획득 횟수 */
+    long nslab;                     /* glibc에서 받은 슬랩 수 */
+
+    struct tstate *next_all;        /* 통계 합산용 전체 목록 */
+    struct tstate *next_idle;
+} tstate_t;
+
+static __thread tstate_t *my_ts;
+static tstate_t *all_ts, *idle_ts;
+static pthread_mutex_t ts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ts_key;
+static pthread_once_t ts_once = PTHREAD_ONCE_INIT;
+static pthread_once_t central_once = PTHREAD_ONCE_INIT;
+
+static const char *tag_names[ALLOC_NTAGS] = {
+    [ALLOC_OTHER] = "alloc_other",
+    [ALLOC_CACHE] = "alloc_cache",
+    [ALLOC_BUF]   = "alloc_buf",
+    [ALLOC_CONN]  = "alloc_conn",
+};
+
+static void bins_release(tstate_t *ts);
+
+/* 스레드 종료: 쌓아 둔 블록을 중앙 목록에 넘기고 통계는 다음 스레드에게 */
+static void ts_exit(void *arg)
+{
+    tstate_t *ts = arg;
+
+    bins_release(ts);
+    my_ts = NULL;
+    pthread_mutex_lock(&ts_lock);
+    ts->next_idle = idle_ts;
+    idle_ts = ts;
+    pthread_mutex_unlock(&ts_lock);
+}
+
+static void ts_key_init(void)
+{
+    pthread_key_create(&ts_key, ts_exit);
+}
+
+static void central_init(void);
+
+static tstate_t *get_ts(void)
+{
+    tstate_t *ts;
+
+    if ((ts = my_ts))
+        return ts;
+    pthread_once(&ts_once, ts_key_init);
+    pthread_once(&central_once, central_init);
+    pthread_mutex_lock(&ts_lock);
+    if ((ts = idle_ts)) {
+        idle_ts = ts->next_idle;
+    } else {
+        if (!(ts = calloc(1, sizeof(tstate_t))))
+            unix_error("alloc error");
+        ts->next_all = all_ts;
+        all_ts = ts;
+    }
+    pthread_mutex_unlock(&ts_lock);
+    pthread_setspecific(ts_key, ts);
+    return my_ts = ts;
+}
+
+/* 요청 크기 → glibc 블록 (헤더 포함) */
+static hdr_t *large_alloc(size_t size)
+{
+    hdr_t *h = malloc(size + HDR_SIZE);
+
+    if (h)
+        h->cls = CLS_LARGE;
+    return h;
+}
+
+#ifdef ALLOC_TCACHE
+/* 등급별 중앙 목록: 넘치는 스레드가 넣고 빈 스레드가 가져간다 */
+static struct {
+    pthread_mutex_t lock;
+    hdr_t *head;
+} central[NCLASSES];
+
+static void central_init(void)
+{
+    for (int i = 0; i < NCLASSES; i++)
+        pthread_mutex_init(&central[i].lock, NULL);
+}
+
+/* 등급 i의 블록 크기 (헤더 포함): 32, 48, 64, 96, 128, 192, ... */
+static size_t class_size(int i)
+{
+    if (i == 0)
+        return 32;
+    return (i & 1) ? 3UL << ((i - 1) / 2 + 4) : 1UL << (i / 2 + 5);
+}
+
+/* 헤더 포함 n바이트를 담는 가장 작은 등급 (2의 거듭제곱 사이에 1.5배 하나) */
+static int size_class(size_t n)
+{
+    if (n <= 32)
+        return 0;
+    int e = 63 - __builtin_clzl(n - 1);    /* 2^e < n <= 2^(e+1) */
+    return (e - 5) * 2 + 1 + (n > (3UL << (e - 1)));
+}
+
+/* 한 번에 옮기는 블록 수 = 슬랩 하나 분량 */
+static int batch_size(int cls)
+{
+    int n = SLAB_BYTES / class_size(cls);
+    return n < SLAB_MIN ? SLAB_MIN : n;
+}
+
+/* 등급 cls 목록의 앞 n개를 떼어 중앙 목록에 한 번에 넘김 */
+static void central_put(tstate_t *ts, int cls, int n)
+{
+    hdr_t *head = ts->bins[cls], *tail = head;
+
+    for (int i = 1; i < n; i++)
+        tail = NEXT(tail);
+    ts->bins[cls] = NEXT(tail);
+    ts->nbin[cls] -= n;
+
+    pthread_mutex_lock(&central[cls].lock);
+    NEXT(tail) = central[cls].head;
+    central[cls].head = head;
+    pthread_mutex_unlock(&central[cls].lock);
+    ts->nmoved += n;
+    ts->nbatch++;
+}
+
+static void bins_release(tstate_t *ts)
+{
+    for (int cls = 0; cls < NCLASSES; cls++)
+        if (ts->nbin[cls])
+            central_put(ts, cls, ts->nbin[cls]);
+}
+
+/* 등급 cls 목록이 비었을 때: 중앙 목록에서 한 묶음, 없으면 새 슬랩 */
+static hdr_t *refill(tstate_t *ts, int cls)
+{
+    int want = batch_size(cls);
+    hdr_t *h;
+
+    pthread_mutex_lock(&central[cls].lock);
+    while ((h = central[cls].head) && want > 0) {
+        central[cls].head = NEXT(h);
+        NEXT(h) = ts->bins[cls];
+        ts->bins[cls] = h;
+        ts->nbin[cls]++;
+        ts->nmoved++;
+        want--;
+    }
+    pthread_mutex_unlock(&central[cls].lock);
+    if (ts->bins[cls]) {
+        ts->nbatch++;
+        return ts->bins[cls];
+    }
+
+    size_t bsize = class_size(cls);
+    int nblk = batch_size(cls);
+    char *slab = malloc(bsize * nblk);
+
+    if (!slab)
+        return NULL;
+    ts->nslab++;
+    for (int i = 0; i < nblk; i++) {
+        h = (hdr_t *)(slab + i * bsize);
+        h->cls = cls;
+        NEXT(h) = ts->bins[cls];
+        ts->bins[cls] = h;
+    }
+    ts->nbin[cls] += nblk;
+    return ts->bins[cls];
+}
+
+static hdr_t *block_alloc(tstate_t *ts, size_t size)
+{
+    if (size + HDR_SIZE > class_size(NCLASSES - 1))
+        return large_alloc(size);
+
+    int cls = size_class(size + HDR_SIZE);
+    hdr_t *h = ts->bins[cls];
+
+    if (!h && !(h = refill(ts, cls)))
+        return NULL;
+    ts->bins[cls] = NEXT(h);
+    ts->nbin[cls]--;
+    return h;
+}
+
+/* 자기 목록에 넣고, 너무 많이 쌓였으면 한 묶음을 중앙 목록으로 */
+static void block_free(tstate_t *ts, hdr_t *h)
+{
+    int cls = h->cls;
+
+    if (cls == CLS_LARGE) {
+        free(h);
+        return;
+    }
+    NEXT(h) = ts->bins[cls];
+    ts->bins[cls] = h;
+    if (++ts->nbin[cls] * class_size(cls) > BIN_MAX_BYTES) {
+        /* 큰 등급(48KB, 64KB)은 한 묶음(SLAB_MIN)이 차기 전에 상한을 넘는다 */
+        int n = batch_size(cls);
+        central_put(ts, cls, n < ts->nbin[cls] ? n : ts->nbin[cls]);
+    }
+}
+
+/* 블록에 (헤더 빼고) 들어갈 수 있는 바이트 */
+static size_t block_room(hdr_t *h)
+{
+    return class_size(h->cls) - HDR_SIZE;
+}
+
+const char *alloc_mode(void) { return "tcache"; }
+
+#else /* glibc */
+
+static void central_init(void) { }
+
+static void bins_release(tstate_t *ts) { }
+
+static hdr_t *block_alloc(tstate_t *ts, size_t size)
+{
+    return large_alloc(size);
+}
+
+static void block_free(tstate_t *ts, hdr_t *h)
+{
+    free(h);
+}
+
+static size_t block_room(hdr_t *h)
+{
+    return 0;                   /* 모든 블록이 CLS_LARGE라 쓰이지 않음 */
+}
+
+const char *alloc_mode(void) { return "glibc"; }
+
+#endif /* ALLOC_TCACHE */
+
+void *Malloc_tag(alloc_tag_t tag, size_t size)
+{
+    tstate_t *ts = get_ts();
+    hdr_t *h;
+
+    if (size > (size_t)-1 - 2 * HDR_SIZE || !(h = block_alloc(ts, size))) {
+        errno = ENOMEM;
+        unix_error("Malloc error");
+    }
+    h->size = size;
+    h->tag = tag;
+    ts->nalloc[tag]++;
+    ts->bytes[tag] += size;
+    return h + 1;
+}
+
+void *Calloc_tag(alloc_tag_t tag, size_t nmemb, size_t size)
+{
+    size_t n;
+    void *p;
+
+    if (__builtin_mul_overflow(nmemb, size, &n)) {
+        errno = ENOMEM;
+        unix_error("Calloc error");
+    }
+    p = Malloc_tag(tag, n);
+    memset(p, 0, n);
+    return p;
+}
+
+void Free_tag(void *ptr)
+{
+    tstate_t *ts;
+    hdr_t *h;
+
+    if (!ptr)
+        return;
+    ts = get_ts();
+    h = (hdr_t *)ptr - 1;
+    ts->nfree[h->tag]++;
+    ts->bytes[h->tag] -= h->size;
+    block_free(ts, h);
+}
+
+void *Realloc_tag(alloc_tag_t tag, void *ptr, size_t size)
+{
+    hdr_t *h;
+    void *p;
+
+    if (!ptr)
+        return Malloc_tag(tag, size);
+    h = (hdr_t *)ptr - 1;
+    if (h->cls == CLS_LARGE) {              /* glibc 블록은 glibc realloc으로 */
+        tstate_t *ts = get_ts();
+        long old = h->size;
+        if (size > (size_t)-1 - 2 * HDR_SIZE || !(h = realloc(h, size + HDR_SIZE))) {
+            errno = ENOMEM;
+            unix_error("Realloc error");
+        }
+        ts->bytes[h->tag] += (long)size - old;
+        h->size = size;
+        return h + 1;
+    }
+    if (size <= block_room(h)) {            /* 같은 등급 안에서 늘고 줄기 */
+        get_ts()->bytes[h->tag] += (long)size - (long)h->size;
+        h->size = size;
+        return ptr;
+    }
+    p = Malloc_tag(h->tag, size);
+    memcpy(p, ptr, size < h->size ? size : h->size);
+    Free_tag(ptr);
+    return p;
+}
+
+void alloc_dump(FILE *fp)
+{
+    long nalloc[ALLOC_NTAGS] = {0}, nfree[ALLOC_NTAGS] = {0}, bytes[ALLOC_NTAGS] = {0};
+    long nmoved = 0, nbatch = 0, nslab = 0;
+
+    pthread_mutex_lock(&ts_lock);
+    for (tstate_t *ts = all_ts; ts; ts = ts->next_all) {
+        for (int i = 0; i < ALLOC_NTAGS; i++) {
+            nalloc[i] += ts->nalloc[i];
+            nfree[i] += ts->nfree[i];
+            bytes[i] += ts->bytes[i];
+        }
+        nmoved += ts->nmoved;
+        nbatch += ts->nbatch;
+        nslab += ts->nslab;
+    }
+    pthread_mutex_unlock(&ts_lock);
+
+    fprintf(fp, "alloc_mode %s\n", alloc_mode());
+    for (int i = 0; i < ALLOC_NTAGS; i++)
+        fprintf(fp, "%s allocs=%ld frees=%ld live_bytes=%ld\n",
+                tag_names[i], nalloc[i], nfree[i], bytes[i]);
+    fprintf(fp, "alloc_central_moves %ld (batches %ld) slabs %ld\n",
+            nmoved, nbatch, nslab);
+}
@@ -0,0 +1,38 @@
+#ifndef __ALLOC_H__
+#define __ALLOC_H__
+
+#include "csapp.h"
+
+/*
+ * 메모리 할당 계층. csapp의 Malloc/Calloc/Realloc/Free가 이걸 거친다.
+ *
+ * 빌드할 때 고른다 (바꾼 뒤에는 make clean):
+ *   make              glibc malloc/free
+ *   make ALLOC=tcache 스레드별 크기 등급 캐시 (-DALLOC_TCACHE)
+ *
+ * 어느 쪽이든 블록마다 16바이트 헤더에 할당한 서브시스템(tag)을 적어
+ * 두므로 Free는 tag 없이 불러도 된다.
+ */
+
+/* 할당 통계를 나눠 셀 서브시스템 */
+typedef enum {
+    ALLOC_OTHER,        /* 시작할 때 만드는 표 등 */
+    ALLOC_CACHE,        /* 캐시 노드, 키, 객체 */
+    ALLOC_BUF,          /* 요청/응답 버퍼 풀 */
+    ALLOC_CONN,         /* 연결별 메타데이터 (코루틴, IP 항목) */
+    ALLOC_NTAGS
+} alloc_tag_t;
+
+/* 실패하면 unix_error로 종료하는 csapp 스타일 래퍼 */
+void *Malloc_tag(alloc_tag_t tag, size_t size);
+void *Calloc_tag(alloc_tag_t tag, size_t nmemb, size_t size);
+void *Realloc_tag(alloc_tag_t tag, void *ptr, size_t size); /* ptr이 NULL일 때만 tag 사용 */
+void Free_tag(void *ptr);
+
+/* "glibc" 또는 "tcache" */
+const char *alloc_mode(void);
+
+/* 서브시스템별 할당/해제 수와 살아있는 바이트를 fp에 출력 */
+void alloc_dump(FILE *fp);
+
+#endif /* __ALLOC_H__ */
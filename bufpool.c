@@ -0,0 +1,129 @@
+/*
+ * bufpool.c - 스레드별 재사용 버퍼 풀
+ *
+ * doit은 미스마다 Malloc(MAX_OBJECT_SIZE)를 했고 (대부분의 응답은 훨씬
+ * 작다), 요청 조립에 고정 크기 스택 배열을 썼다. 이제 요청 조립과
+ * 응답 캡처/중계는 이 풀의 buf_t를 쓰고, 버퍼는 실제로 들어온 바이트
+ * 만큼만 커진다. 다 쓴 버퍼는 크기를 유지한 채 같은 스레드에서 다시 쓴다.
+ */
+#include "bufpool.h"
+#include "stats.h"
+#include "alloc.h"
+#include <stdarg.h>
+
+#define BUF_MIN       1024          /* 첫 할당 크기 */
+#define BUF_KEEP      4             /* 스레드마다 보관할 빈 버퍼 수 */
+#define BUF_KEEP_MAX  (256 * 1024)  /* 이보다 커진 버퍼는 돌려받을 때 해제 */
+
+typedef struct {
+    buf_t *free;
+    int nfree;
+} buf_cache_t;
+
+static __thread buf_cache_t *my_cache;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static void buf_free(buf_t *b)
+{
+    if (b->data)
+        stats_add(STAT_BUF_BYTES, -(long)b->cap);
+    Free(b->data);
+    Free(b);
+}
+
+/* 스레드가 끝날 때 (워커 풀 축소 등) 보관 중인 버퍼 해제 */
+static void cache_destroy(void *arg)
+{
+    buf_cache_t *c = arg;
+    buf_t *b;
+
+    while ((b = c->free)) {
+        c->free = b->next;
+        buf_free(b);
+    }
+    Free(c);
+}
+
+static void cache_key_init(void)
+{
+    pthread_key_create(&cache_key, cache_destroy);
+}
+
+static buf_cache_t *get_cache(void)
+{
+    if (!my_cache) {
+        pthread_once(&cache_once, cache_key_init);
+        my_cache = Calloc_tag(ALLOC_BUF, 1, sizeof(buf_cache_t));
+        pthread_setspecific(cache_key, my_cache);
+    }
+    return my_cache;
+}
+
+buf_t *buf_get(void)
+{
+    buf_cache_t *c = get_cache();
+    buf_t *b;
+
+    if ((b = c->free)) {
+        c->free = b->next;
+        c->nfree--;
+        stats_inc(STAT_BUF_REUSE);
+    } else {
+        b = Calloc_tag(ALLOC_BUF, 1, sizeof(buf_t));  /* data는 첫 쓰기 때 할당 */
+    }
+    b->len = 0;
+    b->next = NULL;
+    return b;
+}
+
+void buf_put(buf_t *b)
+{
+    buf_cache_t *c = get_cache();
+
+    if (c->nfree >= BUF_KEEP || b->cap > BUF_KEEP_MAX) {
+        buf_free(b);
+        return;
+    }
+    b->next = c->free;
+    c->free = b;
+    c->nfree++;
+}
+
+char *buf_reserve(buf_t *b, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : BUF_MIN;
+        while (cap < b->len + n)
+            cap *= 2;
+        b->data = Realloc_tag(ALLOC_BUF, b->data, cap);
+        stats_inc(STAT_BUF_ALLOC);
+        stats_add(STAT_BUF_BYTES, cap - b->cap);
+        b->cap = cap;
+    }
+    return b->data + b->len;
+}
+
+void buf_append(buf_t *b, const void *p, size_t n)
+{
+    memcpy(buf_reserve(b, n), p, n);
+    b->len += n;
+}
+
+void buf_printf(buf_t *b, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && (size_t)n >= b->cap - b->len) {   /* 모자라면 키워서 다시 */
+        buf_reserve(b, n + 1);
+        va_start(ap, fmt);
+        vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+    }
+    if (n > 0)
+        b->len += n;
+}
@@ -0,0 +1,34 @@
+#ifndef __BUFPOOL_H__
+#define __BUFPOOL_H__
+
+#include "csapp.h"
+
+/*
+ * 늘어나는 바이트 버퍼. 처음엔 메모리가 없고, 바이트가 들어올 때
+ * 필요한 만큼만 (두 배씩) 키운다.
+ */
+typedef struct buf {
+    char *data;
+    size_t len;         /* 채워진 바이트 수 */
+    size_t cap;         /* 할당된 크기 */
+    struct buf *next;   /* 스레드 풀의 빈 버퍼 목록 */
+} buf_t;
+
+/*
+ * 이 스레드의 풀에서 빈 버퍼(len 0)를 꺼냄. 풀은 스레드별이라 락이 없다.
+ * 코루틴은 buf_get/buf_put 사이에 양보하지 않으므로 같은 스레드의
+ * 코루틴끼리 버퍼가 섞이지 않는다 (꺼낸 버퍼는 그 연결 것).
+ */
+buf_t *buf_get(void);
+
+/* 버퍼를 이 스레드의 풀에 돌려줌 (너무 크거나 풀이 차 있으면 해제) */
+void buf_put(buf_t *b);
+
+/* 끝에 n바이트를 쓸 자리를 확보하고 그 위치를 리턴 (len은 그대로) */
+char *buf_reserve(buf_t *b, size_t n);
+
+/* 끝에 이어 붙이기 */
+void buf_append(buf_t *b, const void *p, size_t n);
+void buf_printf(buf_t *b, const char *fmt, ...);
+
+#endif /* __BUFPOOL_H__ */
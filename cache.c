@@ -1,18 +1,84 @@
 #include "cache.h"
+#include "alloc.h"
+#include "stats.h"
 
 /* 캐시 리스트의 시작(가장 최근 사용)과 끝(가장 오래된)을 가리킴 */
 static CacheNode *cache_head;
 static CacheNode *cache_tail;
-static int total_cache_size;
+static long total_cache_size;
+static long cache_capacity = MAX_CACHE_SIZE;
+
+/*
+ * [수정] 키 → 노드 해시 색인. 예전에는 cache_find가 목록 전체를 strcmp로
+ * 훑어서 객체 8192개면 미스 하나에 수십 us가 걸렸다. 순서(퇴출)는
+ * 그대로 목록이 맡고, 찾기만 버킷으로 한다.
+ */
+#define CACHE_BUCKETS (1 << 14)
+static CacheNode **cache_index;
+
+static unsigned cache_hash(const char *key) {
+    unsigned h = 2166136261u;               // FNV-1a
+    while (*key)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h & (CACHE_BUCKETS - 1);
+}
 
 /* Readers-Writers Lock */
 static pthread_rwlock_t cache_lock;
 
+/*
+ * [수정] cache_lock 계측. 획득 수는 항상 세고, 대기 시간은 trylock이
+ * 실패했을 때만 잰다 (경합이 없으면 시계를 읽지 않음). 보유 시간은
+ * 스레드마다 LOCK_SAMPLE번에 한 번만 잰다. 락을 쥔 채 양보하는 코루틴은
+ * 없으므로 샘플 시작 시각은 스레드 변수 하나로 충분하다.
+ */
+#define LOCK_SAMPLE 64
+static __thread unsigned lock_seq;
+static __thread long lock_t0;   /* 보유 시간 샘플 시작 (0: 이번엔 안 잼) */
+
+static void cache_lock_acquire(int wr) {
+    int busy = wr ? pthread_rwlock_trywrlock(&cache_lock)
+                  : pthread_rwlock_tryrdlock(&cache_lock);
+
+    stats_inc(wr ? STAT_CACHE_WR_ACQ : STAT_CACHE_RD_ACQ);
+    if (busy) {
+        long t = stats_now_ns();
+        if (wr)
+            pthread_rwlock_wrlock(&cache_lock);
+        else
+            pthread_rwlock_rdlock(&cache_lock);
+        stats_inc(wr ? STAT_CACHE_WR_CONTENDED : STAT_CACHE_RD_CONTENDED);
+        stats_observe(wr ? HIST_CACHE_WR_WAIT : HIST_CACHE_RD_WAIT, stats_now_ns() - t);
+    }
+    lock_t0 = ++lock_seq % LOCK_SAMPLE == 0 ? stats_now_ns() : 0;
+}
+
+static void cache_lock_release(int wr) {
+    if (lock_t0)
+        stats_observe(wr ? HIST_CACHE_WR_HOLD : HIST_CACHE_RD_HOLD, stats_now_ns() - lock_t0);
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+/* 참조를 하나 놓고, 마지막 참조였으면 노드를 해제 */
+static void cache_node_put(CacheNode *node) {
+    if (__atomic_sub_fetch(&node->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        Free(node->key);
+        Free(node->data);
+        Free(node);
+    }
+}
+
 /* 내부 헬퍼 함수: 꼬리에서 노드 제거 (wrlock 안에서 호출되어야 함) */
 static void evict_lru_node() {
     if (cache_tail == NULL) return; // 캐시가 비어있음
 
     CacheNode *node_to_evict = cache_tail;
+    CacheNode **pp = &cache_index[cache_hash(node_to_evict->key)];
+
+    // 색인에서 빼기
+    while (*pp != node_to_evict)
+        pp = &(*pp)->hnext;
+    *pp = node_to_evict->hnext;
 
     // 꼬리 노드 업데이트
     if (cache_tail->prev) {
@@ -23,11 +89,11 @@ static void evict_lru_node() {
         cache_tail = NULL;
     }
     
-    // 리소스 해제
+    // 리소스 해제 (전송 중인 읽기가 있으면 마지막 읽기가 해제)
     total_cache_size -= node_to_evict->size;
-    Free(node_to_evict->key);
-    Free(node_to_evict->data);
-    Free(node_to_evict);
+    stats_add(STAT_CACHE_BYTES, -node_to_evict->size);
+    stats_inc(STAT_CACHE_EVICT);
+    cache_node_put(node_to_evict);
 }
 
 /* 내부 헬퍼 함수: 노드를 리스트 맨 앞으로 이동 (wrlock 안에서 호출됨) */
@@ -57,40 +123,84 @@ void cache_init() {
     cache_head = NULL;
     cache_tail = NULL;
     total_cache_size = 0;
+    cache_index = Calloc_tag(ALLOC_CACHE, CACHE_BUCKETS, sizeof(CacheNode *));
     pthread_rwlock_init(&cache_lock, NULL);
 }
 
+/*
+ * cache_reset - 모든 객체를 퇴출하고 용량을 바꾼다
+ */
+void cache_reset(long capacity) {
+    cache_lock_acquire(1);
+    while (cache_tail)
+        evict_lru_node();
+    cache_capacity = capacity;
+    cache_lock_release(1);
+}
+
 /*
  * cache_find - 'key'(URI)에 해당하는 객체를 찾아 clientfd로 전송
  * 성공 시 1, 실패(miss) 시 0 리턴
+ * 히트였지만 클라이언트로 전송하다 실패하면 -1 리턴 (errno 유지)
  */
 int cache_find(char *key, int clientfd) {
-    pthread_rwlock_rdlock(&cache_lock); // [읽기 락] 획득
+    cache_lock_acquire(0); // [읽기 락] 획득
 
-    CacheNode *current = cache_head;
+    CacheNode *current = cache_index[cache_hash(key)];
     while (current) {
         if (strcmp(current->key, key) == 0) {
             // [캐시 히트!]
 
-            // 1. 데이터를 클라이언트에게 직접 전송
-            Rio_writen(clientfd, current->data, current->size);
+            // 1. 참조를 잡고 락을 먼저 푼다. 느린 클라이언트에게 쓰는 동안
+            //    락을 쥐고 있으면 cache_store가 막히고, 코루틴 모드에서는
+            //    쓰다가 양보한 사이 같은 스레드의 wrlock과 교착된다.
+            __atomic_add_fetch(&current->refcnt, 1, __ATOMIC_RELAXED);
+            cache_lock_release(0); // [읽기 락] 해제
+            stats_inc(STAT_CACHE_HIT);
+
+            // 2. 데이터를 클라이언트에게 직접 전송
+            //    (클라이언트가 끊어도 프로세스가 죽지 않도록 rio_writen 사용)
+            int rc = rio_writen(clientfd, current->data, current->size) < 0 ? -1 : current->size;
+            int saved_errno = errno;
+            cache_node_put(current);
+            errno = saved_errno;
 
             /* * (선택사항) 만약 "읽기"도 LRU 갱신을 해야 한다면,
              * 여기서 rdlock을 풀고, wrlock을 잡은 뒤 move_to_front()를
              * 호출해야 하나, 이는 매우 복잡하고 성능 저하를 유발함.
              * "LRU 근사" 요구사항은 쓰기/퇴출 정책만으로도 만족 가능.
              */
-
-            pthread_rwlock_unlock(&cache_lock); // [읽기 락] 해제
-            return 1; // 1 (찾았음)
+            return rc; // 보낸 바이트 (찾았음) 또는 -1 (전송 실패)
         }
-        current = current->next;
+        current = current->hnext;
     }
 
-    pthread_rwlock_unlock(&cache_lock); // [읽기 락] 해제
+    cache_lock_release(0); // [읽기 락] 해제
+    stats_inc(STAT_CACHE_MISS);
     return 0; // 0 (못 찾음)
 }
 
+/*
+ * cache_get - 'key'의 노드를 참조를 잡아 리턴 (내용을 직접 읽을 때 - 구간 응답 등)
+ * 히트/미스 카운트는 부르는 쪽이 한다
+ */
+CacheNode *cache_get(char *key) {
+    CacheNode *current;
+
+    cache_lock_acquire(0);
+    for (current = cache_index[cache_hash(key)]; current; current = current->hnext)
+        if (strcmp(current->key, key) == 0) {
+            __atomic_add_fetch(&current->refcnt, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    cache_lock_release(0);
+    return current;
+}
+
+void cache_release(CacheNode *node) {
+    cache_node_put(node);
+}
+
 /*
  * cache_store - 'key'와 'data'를 캐시에 저장
  */
@@ -99,18 +209,19 @@ void cache_store(char *key, char *data, int size) {
         return; // 너무 큰 객체는 캐시하지 않음
     }
 
-    pthread_rwlock_wrlock(&cache_lock); // [쓰기 락] 획득
+    cache_lock_acquire(1); // [쓰기 락] 획득
 
     // 1. 공간 확보 (퇴출)
-    while (total_cache_size + size > MAX_CACHE_SIZE) {
+    while (cache_tail && total_cache_size + size > cache_capacity) {
         evict_lru_node();
     }
 
     // 2. 새 캐시 노드 생성
-    CacheNode *new_node = Malloc(sizeof(CacheNode));
-    new_node->key = Malloc(strlen(key) + 1);
-    new_node->data = Malloc(size);
+    CacheNode *new_node = Malloc_tag(ALLOC_CACHE, sizeof(CacheNode));
+    new_node->key = Malloc_tag(ALLOC_CACHE, strlen(key) + 1);
+    new_node->data = Malloc_tag(ALLOC_CACHE, size);
     new_node->size = size;
+    new_node->refcnt = 1; // 리스트가 가진 참조
 
     strcpy(new_node->key, key);
     memcpy(new_node->data, data, size); // 바이너리 데이터이므로 memcpy
@@ -127,8 +238,14 @@ void cache_store(char *key, char *data, int size) {
     if (cache_tail == NULL) { // 리스트가 비어있었다면
         cache_tail = new_node;
     }
+
+    // 4. 색인에 넣기
+    unsigned b = cache_hash(key);
+    new_node->hnext = cache_index[b];
+    cache_index[b] = new_node;
     
     total_cache_size += size;
+    stats_add(STAT_CACHE_BYTES, size);
 
-    pthread_rwlock_unlock(&cache_lock); // [쓰기 락] 해제
+    cache_lock_release(1); // [쓰기 락] 해제
 }
\ No newline at end of file
@@ -12,13 +12,22 @@ typedef struct CacheNode {
     char *key;                // 캐시 키 (요청 URI)
     char *data;               // 웹 객체 데이터
     int size;                 // 데이터 크기
+    int refcnt;               // 리스트가 가진 1 + 지금 전송 중인 읽기 수
     struct CacheNode *prev;
     struct CacheNode *next;
+    struct CacheNode *hnext;  // 해시 버킷 안의 다음 노드
 } CacheNode;
 
 /* 캐시 관리 함수 */
 void cache_init();
-int cache_find(char *key, int clientfd);
+int cache_find(char *key, int clientfd); /* 히트: 보낸 바이트, 미스: 0, 전송 실패: -1 */
+
+/* 찾은 노드의 참조를 잡아서 리턴 (없으면 NULL). 다 쓰면 cache_release */
+CacheNode *cache_get(char *key);
+void cache_release(CacheNode *node);
 void cache_store(char *key, char *data, int size);
 
+/* 캐시를 비우고 전체 용량(바이트)을 바꿈 - 시뮬레이터/벤치마크용 */
+void cache_reset(long capacity);
+
 #endif /* CACHE_H */
\ No newline at end of file
@@ -0,0 +1,216 @@
+/*
+ * cachesim.c - 접근 기록(trace)을 실제 cache.c에 재생하는 오프라인 시뮬레이터
+ *
+ *   usage: ./cachesim [-s size[,size...]] [-j file] trace
+ *
+ *   trace는 한 줄에 요청 하나:
+ *     "<uri> <bytes>"                  (직접 만든 trace)
+ *     "... uri=<uri> ... bytes=<n> ..."  (프록시 -l 접근 로그 그대로)
+ *   파일 전체를 메모리에 올려 두고, 캐시 용량마다 cache_reset 후 처음부터
+ *   재생한다: cache_find가 미스면 cache_store (MAX_OBJECT_SIZE 초과는 저장
+ *   안 됨 = 프록시와 같은 규칙). 용량별로 객체 적중률, 바이트 적중률,
+ *   퇴출 수/바이트를 출력한다.
+ *
+ *   -s 목록이 없으면 MAX_CACHE_SIZE의 1/4 ~ 8배. 크기에는 k/m/g를 붙일 수 있다.
+ *   -j file 이면 용량별 결과를 JSON Lines로 덧붙인다 (microbench와 같은 꼴).
+ *
+ *   히트 시 cache_find가 클라이언트에 쓰는 rio_writen은 링크 단계에서
+ *   -Wl,--wrap=rio_writen 으로 아래 __wrap_rio_writen 에 연결되어 아무것도
+ *   쓰지 않는다. 정책은 cache.c 그대로이므로 cache.c를 바꾸면 다시 빌드만
+ *   하면 같은 trace로 비교할 수 있다.
+ */
+#include "csapp.h"
+#include "stats.h"
+#include "alloc.h"
+#include "cache.h"
+
+/* cache.o의 rio_writen 호출이 여기로 온다 (링크 시 --wrap) */
+ssize_t __wrap_rio_writen(int fd, void *usrbuf, size_t n)
+{
+    return n;
+}
+
+typedef struct {
+    char *uri;
+    long size;
+} req_t;
+
+static req_t *reqs;
+static long nreqs;
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* "256k", "1m" 같은 크기 */
+static long parse_size(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    switch (*end) {
+    case 'k': case 'K': v *= 1024; break;
+    case 'm': case 'M': v *= 1024 * 1024; break;
+    case 'g': case 'G': v *= 1024 * 1024 * 1024; break;
+    }
+    return (long)v;
+}
+
+/* line 안의 "key=값"을 찾아 값의 시작을 돌려줌 (없으면 NULL) */
+static char *field(char *line, const char *key)
+{
+    size_t klen = strlen(key);
+    char *p = line;
+
+    while ((p = strstr(p, key)) != NULL) {
+        if ((p == line || p[-1] == ' ') && p[klen] == '=')
+            return p + klen + 1;
+        p += klen;
+    }
+    return NULL;
+}
+
+/* 한 줄 해석 - 줄은 제자리에서 잘라 uri가 가리키게 둔다 */
+static int parse_line(char *line, req_t *r)
+{
+    char *uri, *bytes, *sp;
+
+    if ((uri = field(line, "uri")) != NULL && (bytes = field(line, "bytes")) != NULL) {
+        r->size = strtol(bytes, NULL, 10);
+        if ((sp = strchr(uri, ' ')) != NULL)
+            *sp = '\0';
+    } else {
+        uri = line;
+        if ((sp = strrchr(line, ' ')) == NULL)
+            return 0;
+        *sp = '\0';
+        r->size = strtol(sp + 1, NULL, 10);
+    }
+    if (*uri == '\0' || r->size < 0)
+        return 0;
+    r->uri = uri;
+    return 1;
+}
+
+/* trace 파일 전체를 읽어 reqs[]를 채운다 */
+static void load_trace(const char *path)
+{
+    struct stat st;
+    int fd = Open((char *)path, O_RDONLY, 0);
+    long cap = 1024, skipped = 0;
+    char *buf, *line, *nl;
+
+    Fstat(fd, &st);
+    buf = Malloc(st.st_size + 1);
+    for (off_t off = 0; off < st.st_size; ) {
+        ssize_t n = Read(fd, buf + off, st.st_size - off);
+        if (n == 0)
+            break;
+        off += n;
+    }
+    buf[st.st_size] = '\0';
+    Close(fd);
+
+    reqs = Malloc(cap * sizeof(req_t));
+    for (line = buf; *line; line = nl) {
+        if ((nl = strchr(line, '\n')) != NULL)
+            *nl++ = '\0';
+        else
+            nl = line + strlen(line);
+        if (nreqs == cap) {
+            cap *= 2;
+            reqs = Realloc(reqs, cap * sizeof(req_t));
+        }
+        if (parse_line(line, &reqs[nreqs]))
+            nreqs++;
+        else if (*line)
+            skipped++;
+    }
+    if (skipped)
+        fprintf(stderr, "cachesim: skipped %ld unparsable lines\n", skipped);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ./cachesim [-s size[,size...]] [-j file] trace\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    static char object[MAX_OBJECT_SIZE];   // 저장할 내용 (값은 상관없음)
+    long sizes[64];
+    int nsizes = 0, c;
+    char *list = NULL, *tok;
+    FILE *json_fp = NULL;
+
+    while ((c = getopt(argc, argv, "s:j:")) != -1) {
+        switch (c) {
+        case 's': list = optarg; break;
+        case 'j': json_fp = Fopen(optarg, "a"); break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+
+    if (list) {
+        for (tok = strtok(list, ","); tok && nsizes < 64; tok = strtok(NULL, ","))
+            sizes[nsizes++] = parse_size(tok);
+    } else {
+        for (int k = -2; k <= 3; k++)
+            sizes[nsizes++] = k < 0 ? MAX_CACHE_SIZE >> -k : (long)MAX_CACHE_SIZE << k;
+    }
+
+    load_trace(argv[optind]);
+    long total_bytes = 0, oversize = 0;
+    for (long i = 0; i < nreqs; i++) {
+        total_bytes += reqs[i].size;
+        oversize += reqs[i].size > MAX_OBJECT_SIZE;
+    }
+    printf("trace %s: %ld requests, %ld bytes, %ld over MAX_OBJECT_SIZE (%d)\n",
+           argv[optind], nreqs, total_bytes, oversize, MAX_OBJECT_SIZE);
+    printf("%12s %10s %10s %12s %14s %10s\n",
+           "capacity", "obj_hit%", "byte_hit%", "evictions", "evicted_bytes", "ns/req");
+
+    cache_init();
+    for (int s = 0; s < nsizes; s++) {
+        long hits = 0, hit_bytes = 0, stored = 0;
+
+        cache_reset(sizes[s]);
+        long evict0 = stats_get(STAT_CACHE_EVICT);
+        long t0 = now_ns();
+        for (long i = 0; i < nreqs; i++) {
+            req_t *r = &reqs[i];
+            if (cache_find(r->uri, -1) > 0) {
+                hits++;
+                hit_bytes += r->size;
+            } else if (r->size <= MAX_OBJECT_SIZE) {
+                cache_store(r->uri, object, r->size);
+                stored += r->size;
+            }
+        }
+        long elapsed = now_ns() - t0;
+        long evictions = stats_get(STAT_CACHE_EVICT) - evict0;
+        /* 넣은 만큼에서 남아 있는 만큼을 빼면 밀려난 바이트 */
+        long evicted_bytes = stored - stats_get(STAT_CACHE_BYTES);
+        double obj_hit = nreqs ? 100.0 * hits / nreqs : 0;
+        double byte_hit = total_bytes ? 100.0 * hit_bytes / total_bytes : 0;
+        double ns_req = nreqs ? (double)elapsed / nreqs : 0;
+
+        printf("%12ld %10.2f %10.2f %12ld %14ld %10.0f\n",
+               sizes[s], obj_hit, byte_hit, evictions, evicted_bytes, ns_req);
+        if (json_fp)
+            fprintf(json_fp, "{\"bench\":\"cachesim\",\"trace\":\"%s\",\"capacity\":%ld,"
+                    "\"requests\":%ld,\"obj_hit_pct\":%.4f,\"byte_hit_pct\":%.4f,"
+                    "\"evictions\":%ld,\"evicted_bytes\":%ld,\"ns_per_req\":%.1f}\n",
+                    argv[optind], sizes[s], nreqs, obj_hit, byte_hit,
+                    evictions, evicted_bytes, ns_req);
+    }
+    if (json_fp)
+        Fclose(json_fp);
+    exit(0);
+}
@@ -0,0 +1,275 @@
+/*
+ * coro.c - ucontext 코루틴 + epoll 스케줄러
+ *
+ * 스케줄러 스레드마다:
+ *   - 들어온 연결 큐 (sbuf, acceptor가 넣고 eventfd로 깨움)
+ *   - 실행 가능한 코루틴 목록 (FIFO)
+ *   - epoll: I/O를 기다리는 코루틴 (EPOLLONESHOT, data.ptr = 코루틴)
+ * 코루틴은 만들어진 스케줄러에서만 돌기 때문에 스케줄러 내부 상태에는
+ * 락이 필요 없다. 스택은 mmap으로 잡고(맨 아래 한 페이지는 guard),
+ * 다 쓴 스택은 스케줄러별 free list에 모아 재사용한다.
+ */
+#include "coro.h"
+#include "sbuf.h"
+#include "stats.h"
+#include "admit.h"
+#include "alloc.h"
+#include "log.h"
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define CORO_STACK   (256 * 1024)  /* doit이 스택에 MAXLINE 배열을 많이 둔다 */
+#define CORO_INQ     1024          /* 스케줄러별 들어온 연결 큐 크기 */
+#define CORO_EVENTS  64
+
+typedef struct coro {
+    ucontext_t ctx;
+    char *stack;            /* mmap한 스택 (guard 페이지 포함) */
+    int connfd;
+    int done;               /* handler가 끝났으면 1 */
+    struct coro *next;      /* 실행 목록 / free list 연결 */
+} coro_t;
+
+typedef struct {
+    int epfd;
+    int evfd;               /* 새 연결이 들어왔음을 알리는 eventfd */
+    sbuf_t inq;             /* 들어온 연결 */
+    ucontext_t main_ctx;    /* 스케줄러 루프의 컨텍스트 */
+    coro_t *ready_head, *ready_tail;
+    coro_t *free_list;      /* 재사용할 코루틴 (스택 포함) */
+} sched_t;
+
+static int nscheds;
+static sched_t *scheds;
+static coro_handler_t coro_handler;
+static unsigned rr_next;
+static long page_size;
+
+static __thread sched_t *cur_sched;    /* 이 스레드의 스케줄러 */
+static __thread coro_t *cur_coro;      /* 지금 실행 중인 코루틴 (없으면 NULL) */
+
+static void ready_push(sched_t *s, coro_t *co)
+{
+    co->next = NULL;
+    if (s->ready_tail)
+        s->ready_tail->next = co;
+    else
+        s->ready_head = co;
+    s->ready_tail = co;
+}
+
+static coro_t *ready_pop(sched_t *s)
+{
+    coro_t *co = s->ready_head;
+
+    if (co && !(s->ready_head = co->next))
+        s->ready_tail = NULL;
+    return co;
+}
+
+/*
+ * fd가 events 상태가 될 때까지 현재 코루틴을 재운다.
+ * EPOLLONESHOT이라 한 번 깨면 해제되므로 다음에는 MOD로 다시 건다.
+ * (닫힌 fd는 epoll에서 자동으로 빠지므로 번호가 재사용되면 ADD가 필요)
+ */
+static void co_wait(int fd, int events)
+{
+    struct epoll_event ev;
+
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = cur_coro;
+    if (epoll_ctl(cur_sched->epfd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+        epoll_ctl(cur_sched->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ready_push(cur_sched, cur_coro);    /* 등록 실패: 바로 다시 시도 */
+    }
+    swapcontext(&cur_coro->ctx, &cur_sched->main_ctx);
+}
+
+/* Rio 훅: 코루틴 안에서는 EAGAIN이면 양보 후 재시도 */
+static ssize_t co_read(int fd, void *buf, size_t n)
+{
+    ssize_t rc;
+
+    while ((rc = read(fd, buf, n)) < 0 && cur_coro &&
+           (errno == EAGAIN || errno == EWOULDBLOCK))
+        co_wait(fd, EPOLLIN | EPOLLRDHUP);
+    return rc;
+}
+
+static ssize_t co_write(int fd, const void *buf, size_t n)
+{
+    ssize_t rc;
+
+    while ((rc = write(fd, buf, n)) < 0 && cur_coro &&
+           (errno == EAGAIN || errno == EWOULDBLOCK))
+        co_wait(fd, EPOLLOUT);
+    return rc;
+}
+
+int co_open_clientfd(char *hostname, char *port)
+{
+    struct addrinfo hints, *listp, *p;
+    int clientfd = -1, rc, err;
+    socklen_t len = sizeof(err);
+
+    if (!cur_coro)
+        return open_clientfd(hostname, port);
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if ((rc = getaddrinfo(hostname, port, &hints, &listp)) != 0) {
+        log_printf("getaddrinfo failed (%s:%s): %s", hostname, port, gai_strerror(rc));
+        return -2;
+    }
+    for (p = listp; p; p = p->ai_next) {
+        if ((clientfd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK,
+                               p->ai_protocol)) < 0)
+            continue;
+        if (connect(clientfd, p->ai_addr, p->ai_addrlen) == 0)
+            break;
+        if (errno == EINPROGRESS) {         /* 연결이 끝나면 쓰기 가능해진다 */
+            co_wait(clientfd, EPOLLOUT);
+            if (getsockopt(clientfd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+                break;
+        }
+        close(clientfd);
+        clientfd = -1;
+    }
+    freeaddrinfo(listp);
+    return clientfd;
+}
+
+/* 코루틴 시작 함수: makecontext는 int 인자만 받으므로 포인터를 둘로 쪼갬 */
+static void co_main(unsigned lo, unsigned hi)
+{
+    coro_t *co = (coro_t *)(((unsigned long)hi << 32) | lo);
+    int flags = fcntl(co->connfd, F_GETFL);
+
+    fcntl(co->connfd, F_SETFL, flags | O_NONBLOCK);
+    coro_handler(co->connfd);
+    co->done = 1;                           /* uc_link로 스케줄러에 돌아감 */
+}
+
+static coro_t *co_create(sched_t *s, int connfd)
+{
+    coro_t *co = s->free_list;
+
+    if (co) {
+        s->free_list = co->next;
+    } else {
+        co = Malloc_tag(ALLOC_CONN, sizeof(coro_t));
+        co->stack = mmap(NULL, CORO_STACK, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (co->stack == MAP_FAILED) {
+            Free(co);
+            return NULL;
+        }
+        mprotect(co->stack, page_size, PROT_NONE);  /* 스택 넘침 감지 */
+    }
+    co->connfd = connfd;
+    co->done = 0;
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack;
+    co->ctx.uc_stack.ss_size = CORO_STACK;
+    co->ctx.uc_link = &s->main_ctx;
+    makecontext(&co->ctx, (void (*)(void))co_main, 2,
+                (unsigned)(unsigned long)co, (unsigned)((unsigned long)co >> 32));
+    stats_inc(STAT_CORO_ACTIVE);
+    return co;
+}
+
+static void *sched_loop(void *vargp)
+{
+    sched_t *s = vargp;
+    struct epoll_event events[CORO_EVENTS];
+    coro_t *co;
+    int connfd;
+    uint64_t cnt;
+
+    Pthread_detach(pthread_self());
+    cur_sched = s;
+    while (1) {
+        /* 1. 새 연결마다 코루틴 생성 */
+        while (sbuf_try_remove(&s->inq, &connfd)) {
+            if ((co = co_create(s, connfd)))
+                ready_push(s, co);
+            else
+                admit_close(connfd);
+        }
+
+        /* 2. 실행 가능한 코루틴을 차례로 실행 (I/O에서 막히면 돌아옴) */
+        while ((co = ready_pop(s))) {
+            cur_coro = co;
+            swapcontext(&s->main_ctx, &co->ctx);
+            cur_coro = NULL;
+            if (co->done) {
+                co->next = s->free_list;
+                s->free_list = co;
+                stats_add(STAT_CORO_ACTIVE, -1);
+            }
+        }
+
+        /* 3. I/O 준비된 코루틴을 깨움 */
+        int n = epoll_wait(s->epfd, events, CORO_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL)
+                read(s->evfd, &cnt, sizeof(cnt));
+            else
+                ready_push(s, events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+void coro_init(int n, coro_handler_t handler)
+{
+    struct epoll_event ev;
+    pthread_t tid;
+
+    nscheds = n;
+    coro_handler = handler;
+    page_size = sysconf(_SC_PAGESIZE);
+    rio_read_hook = co_read;
+    rio_write_hook = co_write;
+
+    scheds = Calloc(nscheds, sizeof(sched_t));
+    for (int i = 0; i < nscheds; i++) {
+        sched_t *s = &scheds[i];
+        if ((s->epfd = epoll_create1(0)) < 0 || (s->evfd = eventfd(0, EFD_NONBLOCK)) < 0)
+            unix_error("coro_init error");
+        sbuf_init(&s->inq, CORO_INQ);
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;                 /* NULL = eventfd */
+        if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->evfd, &ev) < 0)
+            unix_error("coro_init: epoll_ctl error");
+        Pthread_create(&tid, NULL, sched_loop, s);
+    }
+}
+
+/* 연결을 스케줄러 큐에 넣고 eventfd로 깨운다 */
+static int submit(int connfd, int block)
+{
+    sched_t *s = &scheds[__atomic_fetch_add(&rr_next, 1, __ATOMIC_RELAXED) % nscheds];
+    uint64_t one = 1;
+
+    if (!sbuf_try_insert(&s->inq, connfd)) {
+        if (!block)
+            return 0;
+        sbuf_insert(&s->inq, connfd);
+    }
+    if (write(s->evfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "coro: eventfd write: %s\n", strerror(errno));
+    return 1;
+}
+
+void coro_submit(int connfd)
+{
+    submit(connfd, 1);
+}
+
+int coro_try_submit(int connfd)
+{
+    return submit(connfd, 0);
+}
@@ -0,0 +1,30 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include "csapp.h"
+
+/*
+ * coro - ucontext 기반 사용자 수준 스레드(코루틴) 런타임.
+ * 연결마다 코루틴 하나를 만들어 handler(connfd)를 실행한다. handler 안의
+ * Rio 호출은 블로킹처럼 보이지만, 소켓이 준비되지 않으면 epoll 스케줄러로
+ * 양보하므로 적은 수의 OS 스레드로 수천 개의 연결을 동시에 처리한다.
+ */
+
+/* 연결을 처리하는 함수 (connfd를 닫는 것까지 책임진다) */
+typedef void (*coro_handler_t)(int connfd);
+
+/* nsched개의 스케줄러 스레드를 띄우고 Rio 훅을 코루틴용으로 교체 */
+void coro_init(int nsched, coro_handler_t handler);
+
+/* 연결을 스케줄러에 넘김 (라운드 로빈). try 버전은 가득 차면 0 */
+void coro_submit(int connfd);
+int coro_try_submit(int connfd);
+
+/*
+ * open_clientfd의 코루틴 버전: connect가 끝나기를 기다리는 동안 양보한다.
+ * (getaddrinfo는 여전히 블로킹이므로 숫자 주소나 /etc/hosts가 빠르다)
+ * 코루틴 밖에서 부르면 open_clientfd와 같다.
+ */
+int co_open_clientfd(char *hostname, char *port);
+
+#endif /* __CORO_H__ */
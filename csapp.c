@@ -23,6 +23,7 @@
  */
 /* $begin csapp.c */
 #include "csapp.h"
+#include "alloc.h"
 
 /************************** 
  * Error-handling functions
@@ -421,32 +422,21 @@ void Munmap(void *start, size_t length) {
  * Wrappers for dynamic storage allocation functions
  ***************************************************/
 
+/* [수정] 힙 할당은 alloc.c의 할당 계층을 거친다 (make ALLOC=tcache) */
 void *Malloc(size_t size) {
-    void *p;
-
-    if ((p = malloc(size)) == NULL)
-        unix_error("Malloc error");
-    return p;
+    return Malloc_tag(ALLOC_OTHER, size);
 }
 
 void *Realloc(void *ptr, size_t size) {
-    void *p;
-
-    if ((p = realloc(ptr, size)) == NULL)
-        unix_error("Realloc error");
-    return p;
+    return Realloc_tag(ALLOC_OTHER, ptr, size);
 }
 
 void *Calloc(size_t nmemb, size_t size) {
-    void *p;
-
-    if ((p = calloc(nmemb, size)) == NULL)
-        unix_error("Calloc error");
-    return p;
+    return Calloc_tag(ALLOC_OTHER, nmemb, size);
 }
 
 void Free(void *ptr) {
-    free(ptr);
+    Free_tag(ptr);
 }
 
 /******************************************
@@ -690,6 +680,14 @@ void V(sem_t *sem) {
  * The Rio package - Robust I/O functions
  ****************************************/
 
+/*
+ * rio_read_hook/rio_write_hook - The raw read()/write() calls made by
+ *     the Rio functions. The proxy's coroutine runtime points these at
+ *     versions that yield to the scheduler instead of blocking.
+ */
+ssize_t (*rio_read_hook)(int fd, void *buf, size_t n) = read;
+ssize_t (*rio_write_hook)(int fd, const void *buf, size_t n) = write;
+
 /*
  * rio_readn - Robustly read n bytes (unbuffered)
  */
@@ -700,7 +698,7 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n) {
     char *bufp = usrbuf;
 
     while (nleft > 0) {
-        if ((nread = read(fd, bufp, nleft)) < 0) {
+        if ((nread = rio_read_hook(fd, bufp, nleft)) < 0) {
             if (errno == EINTR) /* Interrupted by sig handler return */
                 nread = 0; /* and call read() again */
             else
@@ -725,7 +723,7 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n) {
     char *bufp = usrbuf;
 
     while (nleft > 0) {
-        if ((nwritten = write(fd, bufp, nleft)) <= 0) {
+        if ((nwritten = rio_write_hook(fd, bufp, nleft)) <= 0) {
             if (errno == EINTR) /* Interrupted by sig handler return */
                 nwritten = 0; /* and call write() again */
             else
@@ -754,8 +752,8 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n) {
 
     while (rp->rio_cnt <= 0) {
         /* Refill if buf is empty */
-        rp->rio_cnt = read(rp->rio_fd, rp->rio_buf,
-                           sizeof(rp->rio_buf));
+        rp->rio_cnt = rio_read_hook(rp->rio_fd, rp->rio_buf,
+                                    sizeof(rp->rio_buf));
         if (rp->rio_cnt < 0) {
             if (errno != EINTR) /* Interrupted by sig handler return */
                 return -1;
@@ -238,6 +238,11 @@ void P(sem_t *sem);
 void V(sem_t *sem);
 
 /* Rio (Robust I/O) package */
+/* Low-level read/write used by Rio; the coroutine runtime swaps these */
+extern ssize_t (*rio_read_hook)(int fd, void *buf, size_t n);
+
+extern ssize_t (*rio_write_hook)(int fd, const void *buf, size_t n);
+
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
@@ -0,0 +1,269 @@
+/*
+ * fastlane.c - 캐시 히트 전용 빠른 경로
+ *
+ * acceptor가 연결을 라운드 로빈으로 각 lane의 epoll에 등록하면
+ * (EPOLLONESHOT), lane 스레드는 읽을 수 있게 된 연결의 첫 줄을
+ * MSG_PEEK로 본다.
+ *   - GET이고 캐시 히트: 캐시 객체를 바로 전송하고 받은 바이트를 비움
+ *   - 그 외 (미스, 다른 메소드, 한 번에 안 온 요청 헤더, Range 요청,
+ *     소켓 송신 버퍼에 한 번에 안 들어가는 히트): 워커 풀로
+ *     (또는 코루틴 런타임으로 - fastlane_init에 넘긴 함수가 받는다)
+ * 요청을 FL_TIMEOUT_MS 안에 보내지 않는 연결도 워커 풀로 넘겨서
+ * lane이 연결을 붙잡고 있지 않게 한다.
+ *
+ * lane은 워커 풀 큐가 가득 차도 잠들지 않는다 (잠들면 히트가 다시
+ * 미스 뒤에 줄을 서게 된다). 넣지 못한 미스는 lane의 대기 목록에
+ * 두었다가 다음 루프에서 다시 넣는다.
+ */
+#include "fastlane.h"
+#include "cache.h"
+#include "stats.h"
+#include "admit.h"
+#include "log.h"
+#include "trace.h"
+#include "range.h"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#define FL_MAXEVENTS   64
+#define FL_TIMEOUT_MS 100   /* 요청 라인을 기다려 주는 시간 */
+#define FL_SWEEP_MS    50   /* 오래된 연결을 확인하는 주기 */
+
+/* lane별 상태 (lane 스레드만 건드림, epfd는 acceptor도 사용) */
+typedef struct {
+    int epfd;               /* 이 lane의 epoll 디스크립터 */
+    int *defer;             /* 워커 풀 큐가 가득 차서 아직 못 넘긴 연결 */
+    int ndefer;
+} lane_t;
+
+static int nlanes;
+static lane_t *lanes;
+static unsigned rr_next;    /* 다음에 넣을 lane (acceptor만 사용) */
+static void (*fl_submit)(int);      /* 미스를 넘길 곳 */
+static int (*fl_try_submit)(int);
+static int (*fl_admit)(int);        /* 넘기기 전에 한 번 (0: 거절하고 닫았음) */
+
+/* fd별 상태: 등록 시각 (0이면 fast lane에 없음)과 담당 lane */
+static long *fl_since;
+static int *fl_lane;
+static int fl_max;          /* 표 크기 (RLIMIT_NOFILE) */
+static int fl_hi;           /* 지금까지 등록된 가장 큰 fd */
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* fast lane에서 빼서 워커 풀로 넘긴다 (큐가 가득 차면 대기 목록으로) */
+static void fl_handoff(int lane, int fd)
+{
+    lane_t *lp = &lanes[lane];
+
+    epoll_ctl(lp->epfd, EPOLL_CTL_DEL, fd, NULL);
+    stats_inc(STAT_FAST_HANDOFF);
+    if (!fl_admit(fd))
+        return;
+    if (lp->ndefer > 0 || !fl_try_submit(fd))     /* 순서 유지 */
+        lp->defer[lp->ndefer++] = fd;
+}
+
+/* 대기 목록의 연결을 들어온 순서대로 워커 풀에 넣어본다 */
+static void fl_flush(lane_t *lp)
+{
+    int i = 0;
+
+    while (i < lp->ndefer && fl_try_submit(lp->defer[i]))
+        i++;
+    if (i > 0) {
+        memmove(lp->defer, lp->defer + i, (lp->ndefer - i) * sizeof(int));
+        lp->ndefer -= i;
+    }
+}
+
+/*
+ * [수정] size 바이트가 fd의 송신 버퍼 빈 자리에 들어가는지. 커널은
+ * SO_SNDBUF의 절반 정도를 부가 정보에 쓰므로 절반만 센다.
+ */
+static int fl_fits(int fd, int size)
+{
+    int sndbuf, queued;
+    socklen_t len = sizeof(sndbuf);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0 ||
+        ioctl(fd, SIOCOUTQ, &queued) < 0)
+        return 0;
+    return size <= sndbuf / 2 - queued;
+}
+
+/* 읽을 수 있게 된 연결 하나 처리 */
+static void fl_serve(int lane, int fd)
+{
+    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    long since = fl_since[fd];
+    ssize_t n;
+    char *eol;
+
+    fl_since[fd] = 0;
+    n = recv(fd, buf, sizeof(buf) - 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n <= 0) {
+        if (n < 0 && errno == EAGAIN) {     /* 가짜 깨움: 워커가 기다리게 */
+            fl_handoff(lane, fd);
+            return;
+        }
+        if (n < 0)
+            stats_inc(STAT_CLIENT_READ_ERR);
+        epoll_ctl(lanes[lane].epfd, EPOLL_CTL_DEL, fd, NULL);
+        admit_close(fd);                    /* 요청 없이 끊김 */
+        return;
+    }
+    buf[n] = '\0';
+
+    /*
+     * 요청 헤더가 다 왔고 GET이며 캐시에 있을 때만 여기서 처리.
+     * [수정] Range 요청은 구간만 보내야 하므로 워커가 처리 (doit)
+     */
+    if (!strstr(buf, "\r\n\r\n") || range_find(buf) ||
+        !(eol = strchr(buf, '\n')) ||
+        (*eol = '\0', sscanf(buf, "%s %s %s", method, uri, version) != 3) ||
+        strcasecmp(method, "GET")) {
+        fl_handoff(lane, fd);
+        return;
+    }
+
+    /*
+     * [수정] lane은 쓰기에서 막히면 안 된다 (느린 클라이언트 하나가 이
+     * lane의 히트를 전부 세운다). 송신 버퍼에 다 들어갈 때만 논블로킹으로
+     * 보내고, 큰 객체는 워커가 doit에서 보내게 넘긴다.
+     */
+    CacheNode *node = cache_get(uri);
+    if (!node) {                /* 미스: 소켓은 그대로 (미스는 워커가 센다) */
+        fl_handoff(lane, fd);
+        return;
+    }
+    if (!fl_fits(fd, node->size)) {
+        cache_release(node);
+        fl_handoff(lane, fd);
+        return;
+    }
+    /*
+     * 빈 자리를 확인했으므로 드물지만, 한 바이트도 못 보냈으면 워커에게
+     * 넘기고, 일부만 보냈으면 연결을 버린다. 응답 일부가 이미 나갔으니
+     * 워커가 처음부터 보낼 수 없고, 남은 바이트를 블로킹으로 쓰면 lane이
+     * 멈춘다.
+     */
+    int rc = send(fd, node->data, node->size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        cache_release(node);
+        fl_handoff(lane, fd);
+        return;
+    }
+    stats_inc(STAT_CACHE_HIT);
+    if (rc < node->size)
+        rc = -1;
+    cache_release(node);
+    epoll_ctl(lanes[lane].epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (rc < 0) {
+        stats_inc(STAT_CLIENT_WRITE_ERR);
+    } else {
+        long dur = now_ns() - since;
+        stats_inc(STAT_FAST_HIT);
+        trace_ev(fd, TR_CACHE_HIT);
+        stats_add(STAT_BYTES_SENT, rc);
+        stats_observe(HIST_FAST_HIT, dur);
+        if (log_sampled())
+            log_access(fd, method, uri, 0, rc, "fast", dur);
+        /* 들여다보기만 한 요청을 비운다 (안 읽은 채 닫으면 RST가 나간다) */
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+    }
+    admit_close(fd);
+}
+
+/* 요청을 FL_TIMEOUT_MS 넘게 보내지 않은 이 lane의 연결을 워커 풀로 */
+static void fl_sweep(int lane, long now)
+{
+    int hi = __atomic_load_n(&fl_hi, __ATOMIC_ACQUIRE);
+
+    for (int fd = 0; fd <= hi; fd++) {
+        long since = __atomic_load_n(&fl_since[fd], __ATOMIC_ACQUIRE);
+        if (since && fl_lane[fd] == lane && now - since > FL_TIMEOUT_MS * 1000000L) {
+            fl_since[fd] = 0;
+            stats_inc(STAT_FAST_TIMEOUT);
+            fl_handoff(lane, fd);
+        }
+    }
+}
+
+static void *fl_thread(void *vargp)
+{
+    int lane = (int)(long)vargp;
+    lane_t *lp = &lanes[lane];
+    struct epoll_event events[FL_MAXEVENTS];
+    long last_sweep = now_ns();
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        if (lp->ndefer > 0)
+            fl_flush(lp);
+        /* 못 넘긴 연결이 있으면 짧게 기다렸다가 다시 시도 */
+        int n = epoll_wait(lp->epfd, events, FL_MAXEVENTS, lp->ndefer ? 1 : FL_SWEEP_MS);
+        for (int i = 0; i < n; i++)
+            fl_serve(lane, events[i].data.fd);
+
+        long now = now_ns();
+        if (now - last_sweep > FL_SWEEP_MS * 1000000L) {
+            fl_sweep(lane, now);
+            last_sweep = now;
+        }
+    }
+    return NULL;
+}
+
+void fastlane_init(int n, void (*submit)(int), int (*try_submit)(int),
+                   int (*admit)(int))
+{
+    struct rlimit rl;
+    pthread_t tid;
+
+    nlanes = n;
+    fl_submit = submit;
+    fl_try_submit = try_submit;
+    fl_admit = admit;
+    fl_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+             ? rl.rlim_cur : 65536;
+    fl_since = Calloc(fl_max, sizeof(long));
+    fl_lane = Calloc(fl_max, sizeof(int));
+    lanes = Calloc(nlanes, sizeof(lane_t));
+    for (long i = 0; i < nlanes; i++) {
+        if ((lanes[i].epfd = epoll_create1(0)) < 0)
+            unix_error("fastlane_init: epoll_create1 error");
+        lanes[i].defer = Calloc(fl_max, sizeof(int));
+        Pthread_create(&tid, NULL, fl_thread, (void *)i);
+    }
+}
+
+void fastlane_submit(int connfd)
+{
+    struct epoll_event ev;
+    int lane = rr_next++ % nlanes;
+
+    if (connfd >= fl_max) {             /* 표 밖의 fd는 바로 워커 풀로 */
+        fl_submit(connfd);
+        return;
+    }
+    fl_lane[connfd] = lane;
+    __atomic_store_n(&fl_since[connfd], now_ns(), __ATOMIC_RELEASE);
+    if (connfd > fl_hi)
+        __atomic_store_n(&fl_hi, connfd, __ATOMIC_RELEASE);
+
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.fd = connfd;
+    if (epoll_ctl(lanes[lane].epfd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+        fl_since[connfd] = 0;
+        fl_submit(connfd);
+    }
+}
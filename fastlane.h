@@ -0,0 +1,25 @@
+#ifndef __FASTLANE_H__
+#define __FASTLANE_H__
+
+#include "csapp.h"
+
+/*
+ * fast lane - 캐시 히트를 워커 풀 큐 앞에서 바로 처리하는 가벼운 스레드들.
+ * 요청 라인을 MSG_PEEK로 들여다보고, 캐시에 있으면 그 자리에서 응답한다.
+ * 미스(또는 판단할 수 없는 요청)는 소켓을 건드리지 않은 채로 워커 풀에
+ * 넘기므로 doit은 처음부터 평소대로 읽으면 된다.
+ */
+
+/*
+ * nlanes개의 fast lane 스레드 시작. 미스는 admit 검사를 한 번 거친 뒤
+ * (0이면 admit이 이미 닫았음) try_submit으로 넘기고 (가득 차면 lane이
+ * 들고 있다가 재시도 - 검사는 다시 하지 않음), lane에 넣을 수 없는 연결은
+ * submit으로 바로 넘긴다. 워커 풀/코루틴 런타임을 먼저 초기화할 것.
+ */
+void fastlane_init(int nlanes, void (*submit)(int), int (*try_submit)(int),
+                   int (*admit)(int));
+
+/* 새 연결을 fast lane에 등록 */
+void fastlane_submit(int connfd);
+
+#endif /* __FASTLANE_H__ */
@@ -0,0 +1,29 @@
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* *addr가 아직 val이면 잠든다 (timeout은 상대 시간, NULL이면 무한정) */
+static inline void futex_wait(int *addr, int val, const struct timespec *timeout)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+/* addr에서 잠든 스레드를 최대 n개 깨운다 */
+static inline void futex_wake(int *addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* 스핀 루프 안에서 다른 하이퍼스레드에 양보 */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+#endif /* __FUTEX_H__ */
@@ -0,0 +1,515 @@
+/*
+ * loadgen.c - 프록시(또는 tiny)에 부하를 거는 HTTP 부하 생성기
+ *
+ *   usage: ./loadgen [-c conns] [-n requests | -d seconds] [-t threads] [-k]
+ *                    [-x proxy_host:port] [-u url_file] [-m sizes] [-D docroot]
+ *                    [-z zipf_s] [-H header] <host:port>
+ *
+ *   -c  동시에 열어 둘 연결 수 (기본 16)
+ *   -n  보낼 요청 수 (기본 10000) / -d 이 시간(초) 동안 보냄
+ *   -t  이벤트 루프 스레드 수 (연결은 스레드에 나눠 줌, 기본 1)
+ *   -k  keep-alive: 서버가 닫지 않으면 연결을 재사용 (기본은 요청마다 새 연결)
+ *   -x  요청을 이 프록시로 보냄 (절대 URI). 없으면 <host:port>에 직접
+ *   -u  경로 목록 파일 (한 줄에 하나, 예: /home.html). 기본은 /home.html
+ *   -m  크기 목록 (예: 1k,16k,100k,1m): docroot에 lg_<bytes>.bin 파일을
+ *       만들어 (없을 때만) 그 경로들을 목록으로 쓴다
+ *   -D  -m으로 만들 파일의 위치 (기본 ./tiny)
+ *   -z  Zipf 지수: 목록의 i번째(1부터)를 1/i^s 비율로 고름 (0: 균등, 기본 0)
+ *   -H  요청마다 붙일 헤더 한 줄 (예: "Accept-Encoding: gzip")
+ *
+ * 연결은 논블로킹 소켓과 epoll로 돌린다 (스레드 하나가 많은 연결을 다룸).
+ * 지연은 요청을 보내기 시작한 때부터 (새 연결이면 connect 시작부터)
+ * 응답 끝까지이고, 끝에 처리량과 p50/p90/p99/p99.9를 출력한다.
+ *
+ * 예: tiny와 proxy를 띄운 뒤
+ *   ./loadgen -c 64 -n 100000 -z 1.1 -m 1k,10k,100k -x localhost:<proxy> localhost:<tiny>
+ */
+#include "csapp.h"
+#include <sys/epoll.h>
+
+#define LG_MAX_URLS 4096
+#define LG_HDR_MAX  8192        /* 응답 헤더 최대 길이 */
+#define LG_TIMEOUT_NS (10 * 1000000000L)   /* 응답이 이보다 늦으면 오류 */
+
+enum { C_IDLE, C_CONNECTING, C_WRITING, C_READING };
+
+typedef struct {
+    int fd;
+    int state;
+    int reused;                 /* keep-alive로 재사용 중인 연결 */
+    char req[MAXLINE];
+    int reqlen, sent;
+    char hdr[LG_HDR_MAX];       /* 응답 헤더 (본문은 세기만 하고 버림) */
+    int hdrlen;
+    int hdr_done;
+    int status;
+    int close_after;            /* 서버가 Connection: close */
+    long clen;                  /* Content-Length (-1: 없음 = 닫힐 때까지) */
+    long body;                  /* 받은 본문 바이트 */
+    long t0;
+} lg_conn_t;
+
+typedef struct {
+    int id;
+    int nconns;
+    long *lat;                  /* 요청별 지연 (ns) */
+    long nlat, caplat;
+    long errors, non200, bytes, connects;
+    pthread_t tid;
+} lg_thread_t;
+
+/* 설정 (main에서 채운 뒤 읽기만 함) */
+static struct addrinfo *dest;   /* 연결할 주소 (프록시 또는 서버) */
+static char target[MAXLINE];    /* 절대 URI 앞부분 "http://host:port" (프록시 모드) */
+static char host_hdr[MAXLINE];
+static char extra_hdr[MAXLINE];   /* -H 헤더 ("이름: 값\r\n", 없으면 "") */
+static int use_proxy, keepalive;
+static char *urls[LG_MAX_URLS];
+static int nurls;
+static double *zipf_cdf;
+static long total_reqs = 10000;
+static long deadline_ns;        /* 0이 아니면 -d 모드 */
+static long issued;             /* 모든 스레드가 보낸 요청 수 (원자적) */
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* 정렬된 배열에서 백분위수 */
+static long pct(long *v, long n, double p)
+{
+    long i = (long)(p / 100.0 * (n - 1));
+    return n ? v[i] : 0;
+}
+
+/* 스레드별 xorshift (rand()는 전역 락을 잡음) */
+static unsigned long xorshift(unsigned long *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/* Zipf 누적 분포: cdf[i] = sum_{k<=i} 1/(k+1)^s / H */
+static void zipf_init(double s)
+{
+    double sum = 0;
+
+    zipf_cdf = Malloc(nurls * sizeof(double));
+    for (int i = 0; i < nurls; i++) {
+        sum += 1.0 / pow(i + 1, s);
+        zipf_cdf[i] = sum;
+    }
+    for (int i = 0; i < nurls; i++)
+        zipf_cdf[i] /= sum;
+}
+
+static int pick_url(unsigned long *seed)
+{
+    double u = (xorshift(seed) >> 11) * (1.0 / (1UL << 53));
+    int lo = 0, hi = nurls - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (zipf_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* 다음 요청을 보내도 되는지 (요청 수 또는 시간) */
+static int take_request(void)
+{
+    if (deadline_ns)
+        return now_ns() < deadline_ns;
+    return __atomic_fetch_add(&issued, 1, __ATOMIC_RELAXED) < total_reqs;
+}
+
+static void conn_close(int epfd, lg_conn_t *c)
+{
+    if (c->fd >= 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    }
+    c->fd = -1;
+    c->reused = 0;
+    c->state = C_IDLE;
+}
+
+static void conn_watch(int epfd, lg_conn_t *c, unsigned events, int op)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(epfd, op, c->fd, &ev);
+}
+
+/* 새 요청 시작: 연결이 없으면 논블로킹 connect부터 */
+static int conn_start(int epfd, lg_thread_t *t, lg_conn_t *c, unsigned long *seed)
+{
+    const char *path = urls[pick_url(seed)];
+
+    c->reqlen = snprintf(c->req, sizeof(c->req),
+                         "GET %s%s HTTP/1.0\r\nHost: %s\r\nConnection: %s\r\n%s\r\n",
+                         use_proxy ? target : "", path, host_hdr,
+                         keepalive ? "keep-alive" : "close", extra_hdr);
+    c->sent = 0;
+    c->hdrlen = c->hdr_done = c->status = c->close_after = 0;
+    c->clen = -1;
+    c->body = 0;
+    c->t0 = now_ns();
+
+    if (c->fd >= 0) {
+        c->state = C_WRITING;
+        conn_watch(epfd, c, EPOLLOUT, EPOLL_CTL_MOD);
+        return 0;
+    }
+    if ((c->fd = socket(dest->ai_family, SOCK_STREAM, 0)) < 0)
+        return -1;
+    fcntl(c->fd, F_SETFL, O_NONBLOCK);
+    t->connects++;
+    if (connect(c->fd, dest->ai_addr, dest->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    c->state = C_CONNECTING;
+    conn_watch(epfd, c, EPOLLOUT, EPOLL_CTL_ADD);
+    return 0;
+}
+
+/* Connection 헤더 값이 close인지 */
+static int is_close(const char *v)
+{
+    while (*v == ' ' || *v == '\t')
+        v++;
+    return !strncasecmp(v, "close", 5);
+}
+
+/* 헤더가 다 왔으면 상태 코드, Content-Length, Connection을 읽는다 */
+static void parse_header(lg_conn_t *c)
+{
+    char *end, *p;
+
+    c->hdr[c->hdrlen] = '\0';
+    if (!(end = strstr(c->hdr, "\r\n\r\n")))
+        return;
+    c->hdr_done = 1;
+    c->body = c->hdrlen - (end + 4 - c->hdr);   /* 헤더와 같이 온 본문 */
+    *end = '\0';
+    if ((p = strchr(c->hdr, ' ')))
+        c->status = atoi(p + 1);
+    for (p = strstr(c->hdr, "\r\n"); p; p = strstr(p + 2, "\r\n")) {
+        if (!strncasecmp(p + 2, "Content-length:", 15))
+            c->clen = atol(p + 17);
+        else if (!strncasecmp(p + 2, "Connection:", 11) && is_close(p + 13))
+            c->close_after = 1;
+    }
+    /* HTTP/1.0 응답은 keep-alive라고 밝히지 않으면 닫힌다 */
+    if (!keepalive || c->clen < 0)
+        c->close_after = 1;
+}
+
+/* 요청 하나를 마침: 지연 기록 후 다음 요청 */
+static void conn_done(int epfd, lg_thread_t *t, lg_conn_t *c, unsigned long *seed)
+{
+    if (t->nlat == t->caplat) {
+        t->caplat = t->caplat ? t->caplat * 2 : 4096;
+        t->lat = Realloc(t->lat, t->caplat * sizeof(long));
+    }
+    t->lat[t->nlat++] = now_ns() - c->t0;
+    if (c->status != 200)
+        t->non200++;
+    t->bytes += c->body;
+
+    int more = take_request();
+
+    if (c->close_after || !more)
+        conn_close(epfd, c);        /* 끝났으면 keep-alive 연결도 닫음 */
+    else
+        c->reused = 1;
+    if (more && conn_start(epfd, t, c, seed) < 0)
+        t->errors++;
+}
+
+static void conn_fail(int epfd, lg_thread_t *t, lg_conn_t *c, unsigned long *seed)
+{
+    /* 재사용한 연결을 서버가 이미 닫았으면 오류가 아님: 새 연결로 다시 */
+    int retry = c->reused && c->hdrlen == 0;
+
+    conn_close(epfd, c);
+    if (!retry) {
+        t->errors++;
+        if (!take_request())
+            return;
+    }
+    if (conn_start(epfd, t, c, seed) < 0)
+        t->errors++;
+}
+
+static void conn_event(int epfd, lg_thread_t *t, lg_conn_t *c, unsigned long *seed)
+{
+    char buf[65536];
+    ssize_t n;
+    int err;
+    socklen_t len = sizeof(err);
+
+    switch (c->state) {
+    case C_CONNECTING:
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+            conn_fail(epfd, t, c, seed);
+            return;
+        }
+        c->state = C_WRITING;
+        /* fall through */
+    case C_WRITING:
+        while (c->sent < c->reqlen) {
+            if ((n = write(c->fd, c->req + c->sent, c->reqlen - c->sent)) < 0) {
+                if (errno != EAGAIN)
+                    conn_fail(epfd, t, c, seed);
+                return;
+            }
+            c->sent += n;
+        }
+        c->state = C_READING;
+        conn_watch(epfd, c, EPOLLIN, EPOLL_CTL_MOD);
+        return;
+    case C_READING:
+        while (1) {
+            if (!c->hdr_done) {
+                n = read(c->fd, c->hdr + c->hdrlen, LG_HDR_MAX - 1 - c->hdrlen);
+                if (n > 0) {
+                    c->hdrlen += n;
+                    parse_header(c);
+                    if (!c->hdr_done && c->hdrlen == LG_HDR_MAX - 1) {
+                        conn_fail(epfd, t, c, seed);
+                        return;
+                    }
+                }
+            } else {
+                n = read(c->fd, buf, sizeof(buf));
+                if (n > 0)
+                    c->body += n;
+            }
+            if (n == 0) {           /* 서버가 닫음: 길이를 모르는 본문의 끝 */
+                if (c->hdr_done && c->clen < 0) {
+                    c->close_after = 1;
+                    conn_done(epfd, t, c, seed);
+                } else {
+                    conn_fail(epfd, t, c, seed);
+                }
+                return;
+            }
+            if (n < 0) {
+                if (errno != EAGAIN)
+                    conn_fail(epfd, t, c, seed);
+                return;
+            }
+            if (c->hdr_done && c->clen >= 0 && c->body >= c->clen) {
+                conn_done(epfd, t, c, seed);
+                return;
+            }
+        }
+    }
+}
+
+static void *lg_thread(void *vargp)
+{
+    lg_thread_t *t = vargp;
+    lg_conn_t *conns = Calloc(t->nconns, sizeof(lg_conn_t));
+    struct epoll_event evs[256];
+    unsigned long seed = 0x9e3779b97f4a7c15UL * (t->id + 1);
+    int epfd = epoll_create1(0), active;
+
+    for (int i = 0; i < t->nconns; i++) {
+        conns[i].fd = -1;
+        if (take_request() && conn_start(epfd, t, &conns[i], &seed) < 0)
+            t->errors++;
+    }
+    while (1) {
+        active = 0;
+        for (int i = 0; i < t->nconns; i++)
+            active += conns[i].state != C_IDLE;
+        if (!active)
+            break;
+        int n = epoll_wait(epfd, evs, 256, 1000);
+        for (int i = 0; i < n; i++)
+            conn_event(epfd, t, evs[i].data.ptr, &seed);
+        if (n == 0) {               /* 조용하면 멈춘 연결을 찾아 포기 */
+            long now = now_ns();
+            for (int i = 0; i < t->nconns; i++)
+                if (conns[i].state != C_IDLE && now - conns[i].t0 > LG_TIMEOUT_NS) {
+                    conns[i].reused = 0;
+                    conn_fail(epfd, t, &conns[i], &seed);
+                }
+        }
+    }
+    for (int i = 0; i < t->nconns; i++)
+        conn_close(epfd, &conns[i]);
+    close(epfd);
+    Free(conns);
+    return NULL;
+}
+
+/* 경로 목록 파일 읽기 (빈 줄과 #로 시작하는 줄은 무시) */
+static void load_urls(const char *file)
+{
+    char line[MAXLINE];
+    FILE *fp = Fopen((char *)file, "r");
+
+    while (nurls < LG_MAX_URLS && Fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        urls[nurls++] = strdup(line);
+    }
+    Fclose(fp);
+}
+
+/* "1k,16k,1m" → docroot/lg_<bytes>.bin을 (없으면) 만들고 목록에 추가 */
+static void make_objects(char *sizes, const char *docroot)
+{
+    char path[MAXLINE], *tok, *end;
+
+    for (tok = strtok(sizes, ","); tok && nurls < LG_MAX_URLS; tok = strtok(NULL, ",")) {
+        long n = strtol(tok, &end, 10);
+        if (*end == 'k' || *end == 'K')
+            n <<= 10;
+        else if (*end == 'm' || *end == 'M')
+            n <<= 20;
+        snprintf(path, sizeof(path), "%s/lg_%ld.bin", docroot, n);
+        if (access(path, R_OK) < 0) {
+            int fd = Open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            char blk[4096];
+            memset(blk, 'x', sizeof(blk));
+            for (long left = n; left > 0; left -= sizeof(blk))
+                Rio_writen(fd, blk, left < sizeof(blk) ? left : sizeof(blk));
+            Close(fd);
+        }
+        snprintf(path, sizeof(path), "/lg_%ld.bin", n);
+        urls[nurls++] = strdup(path);
+    }
+}
+
+/* "host:port" 나누기 */
+static void split_hostport(char *s, char **host, char **port)
+{
+    char *colon = strrchr(s, ':');
+
+    if (!colon) {
+        fprintf(stderr, "expected host:port, got %s\n", s);
+        exit(1);
+    }
+    *colon = '\0';
+    *host = s;
+    *port = colon + 1;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-c conns] [-n requests | -d seconds] [-t threads] [-k]\n"
+                    "       [-x proxy_host:port] [-u url_file] [-m sizes] [-D docroot]\n"
+                    "       [-z zipf_s] [-H header] <host:port>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int nconns = 16, nthreads = 1, c;
+    double zipf_s = 0, secs = 0;
+    char *proxy = NULL, *url_file = NULL, *sizes = NULL, *docroot = "./tiny";
+    char *host, *port;
+    struct addrinfo hints;
+    int rc;
+
+    while ((c = getopt(argc, argv, "c:n:d:t:kx:u:m:D:z:H:")) != -1) {
+        switch (c) {
+        case 'c': nconns = atoi(optarg); break;
+        case 'n': total_reqs = atol(optarg); break;
+        case 'd': secs = atof(optarg); break;
+        case 't': nthreads = atoi(optarg); break;
+        case 'k': keepalive = 1; break;
+        case 'x': proxy = optarg; break;
+        case 'u': url_file = optarg; break;
+        case 'm': sizes = optarg; break;
+        case 'D': docroot = optarg; break;
+        case 'z': zipf_s = atof(optarg); break;
+        case 'H': snprintf(extra_hdr, sizeof(extra_hdr), "%s\r\n", optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || nconns < 1 || nthreads < 1)
+        usage(argv[0]);
+    if (nthreads > nconns)
+        nthreads = nconns;
+
+    if (url_file)
+        load_urls(url_file);
+    if (sizes)
+        make_objects(sizes, docroot);
+    if (nurls == 0)
+        urls[nurls++] = "/home.html";
+    zipf_init(zipf_s);
+
+    /* 서버 주소는 Host 헤더와 절대 URI에, 연결은 프록시(있으면)로 */
+    snprintf(target, sizeof(target), "http://%s", argv[optind]);
+    snprintf(host_hdr, sizeof(host_hdr), "%s", argv[optind]);
+    use_proxy = proxy != NULL;
+    split_hostport(proxy ? proxy : argv[optind], &host, &port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if ((rc = getaddrinfo(host, port, &hints, &dest)) != 0) {
+        fprintf(stderr, "getaddrinfo %s:%s: %s\n", host, port, gai_strerror(rc));
+        exit(1);
+    }
+    Signal(SIGPIPE, SIG_IGN);
+
+    lg_thread_t *ts = Calloc(nthreads, sizeof(lg_thread_t));
+    long start = now_ns();
+    if (secs > 0)
+        deadline_ns = start + (long)(secs * 1e9);
+    for (int i = 0; i < nthreads; i++) {
+        ts[i].id = i;
+        ts[i].nconns = nconns / nthreads + (i < nconns % nthreads);
+        Pthread_create(&ts[i].tid, NULL, lg_thread, &ts[i]);
+    }
+
+    long nlat = 0, errors = 0, non200 = 0, bytes = 0, connects = 0;
+    for (int i = 0; i < nthreads; i++) {
+        Pthread_join(ts[i].tid, NULL);
+        nlat += ts[i].nlat;
+        errors += ts[i].errors;
+        non200 += ts[i].non200;
+        bytes += ts[i].bytes;
+        connects += ts[i].connects;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    long *lat = Malloc((nlat ? nlat : 1) * sizeof(long)), k = 0;
+    for (int i = 0; i < nthreads; i++) {
+        memcpy(lat + k, ts[i].lat, ts[i].nlat * sizeof(long));
+        k += ts[i].nlat;
+    }
+    qsort(lat, nlat, sizeof(long), cmp_long);
+
+    printf("urls %d zipf %.2f conns %d threads %d %s %s\n", nurls, zipf_s, nconns,
+           nthreads, keepalive ? "keep-alive" : "close", use_proxy ? "via-proxy" : "direct");
+    printf("requests %ld errors %ld non200 %ld connects %ld secs %.2f\n",
+           nlat, errors, non200, connects, elapsed);
+    printf("throughput %.0f req/s %.2f MB/s\n", nlat / elapsed, bytes / elapsed / 1e6);
+    printf("latency_us p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+           pct(lat, nlat, 50) / 1e3, pct(lat, nlat, 90) / 1e3, pct(lat, nlat, 99) / 1e3,
+           pct(lat, nlat, 99.9) / 1e3, (nlat ? lat[nlat - 1] : 0) / 1e3);
+    return errors > 0;
+}
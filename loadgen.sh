@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# loadgen.sh - tiny와 그 앞의 proxy를 localhost에 띄우고 loadgen을 돌린다
+#
+#     usage: ./loadgen.sh [proxy 옵션 --] [loadgen 옵션]
+#     예:    ./loadgen.sh -c 64 -n 100000 -z 1.1 -m 1k,10k,100k
+#            ./loadgen.sh -t 4 -T 16 -- -c 128 -d 10
+#
+# loadgen 옵션 중 -x와 <host:port>는 이 스크립트가 붙인다.
+#
+
+PROXY_ARGS=()
+if [[ " $* " == *" -- "* ]]; then
+    while [ "$1" != "--" ]; do
+        PROXY_ARGS+=("$1")
+        shift
+    done
+    shift
+fi
+
+make -s proxy loadgen && make -s -C tiny || exit 1
+
+tiny_port=`bash free-port.sh`
+(cd tiny && exec ./tiny ${tiny_port} &> /dev/null) &
+tiny_pid=$!
+sleep 1     # tiny가 포트를 잡은 뒤에 찾아야 같은 포트가 안 나온다
+proxy_port=`bash free-port.sh`
+./proxy -l 0 "${PROXY_ARGS[@]}" ${proxy_port} &> /dev/null &
+proxy_pid=$!
+sleep 1
+
+./loadgen "$@" -x localhost:${proxy_port} localhost:${tiny_port}
+status=$?
+
+kill ${proxy_pid} ${tiny_pid} 2> /dev/null
+wait 2> /dev/null
+exit ${status}
@@ -0,0 +1,195 @@
+/*
+ * log.c - 스레드별 링 버퍼와 writer 스레드로 된 비동기 로그
+ *
+ * 예전에는 main이 연결마다 getnameinfo(역방향 DNS)와 printf를 하고, 모든
+ * 워커가 "Cache hit/miss"를 stdout에 printf했다. 요청 경로에서 DNS를
+ * 기다리고 stdio 락을 두고 다퉜다. 이제 각 스레드는 자기 링(단일 생산자/
+ * 단일 소비자)에 포맷한 줄을 넣고, writer가 주기적으로 (링이 반쯤 차면
+ * 바로) 모아서 쓴다.
+ *
+ * 코루틴은 log_* 안에서 양보하지 않으므로 한 스레드의 코루틴들이 링을
+ * 같이 써도 생산자는 하나다. 끝난 스레드의 링은 다음 스레드가 물려받는다.
+ */
+#include "log.h"
+#include "stats.h"
+#include "futex.h"
+#include <stdarg.h>
+
+#define LOG_SLOTS    256        /* 스레드 링의 줄 수 (2의 거듭제곱) */
+#define LOG_LINE     256        /* 한 줄 최대 길이 (넘으면 잘림) */
+#define LOG_FLUSH_MS 10         /* writer가 링을 훑는 주기 */
+
+typedef struct log_ring {
+    char lines[LOG_SLOTS][LOG_LINE];
+    size_t head __attribute__((aligned(64)));   /* 생산자가 다음에 쓸 위치 */
+    size_t tail __attribute__((aligned(64)));   /* writer가 다음에 읽을 위치 */
+    unsigned seen;                              /* 샘플링 카운터 */
+    struct log_ring *next;                      /* writer가 훑는 전체 목록 */
+    struct log_ring *next_idle;
+} log_ring_t;
+
+static FILE *log_out;
+static int log_sample = 1;
+static log_ring_t *all_rings, *idle_rings;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static int log_ev;              /* 링이 반쯤 차면 증가시켜 writer를 깨움 */
+static int log_started;
+
+static __thread log_ring_t *my_ring;
+
+/* 스레드가 끝나면 링을 다음 스레드에게 (남은 줄은 writer가 마저 씀) */
+static void ring_exit(void *arg)
+{
+    log_ring_t *r = arg;
+
+    my_ring = NULL;
+    pthread_mutex_lock(&ring_lock);
+    r->next_idle = idle_rings;
+    idle_rings = r;
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static log_ring_t *get_ring(void)
+{
+    log_ring_t *r;
+
+    if ((r = my_ring))
+        return r;
+    pthread_mutex_lock(&ring_lock);
+    if ((r = idle_rings)) {
+        idle_rings = r->next_idle;
+    } else {
+        r = Calloc(1, sizeof(log_ring_t));
+        r->next = all_rings;
+        __atomic_store_n(&all_rings, r, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&ring_lock);
+    pthread_setspecific(ring_key, r);
+    return my_ring = r;
+}
+
+/* 링에 빈 줄 하나를 잡음 (가득 차면 NULL) */
+static char *ring_slot(log_ring_t *r)
+{
+    size_t head = r->head;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_SLOTS) {
+        stats_inc(STAT_LOG_DROPPED);
+        return NULL;
+    }
+    return r->lines[head & (LOG_SLOTS - 1)];
+}
+
+/* 채운 줄을 writer에게 공개 */
+static void ring_commit(log_ring_t *r)
+{
+    size_t head = r->head + 1;
+
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_RELAXED) == LOG_SLOTS / 2) {
+        __atomic_fetch_add(&log_ev, 1, __ATOMIC_RELEASE);
+        futex_wake(&log_ev, 1);
+    }
+}
+
+/* 줄 끝을 \n으로 맞춤 (잘렸으면 잘린 자리에) */
+static void end_line(char *line, int n)
+{
+    if (n < 0)
+        n = 0;
+    if (n > LOG_LINE - 2)
+        n = LOG_LINE - 2;
+    line[n] = '\n';
+    line[n + 1] = '\0';
+}
+
+void log_printf(const char *fmt, ...)
+{
+    log_ring_t *r;
+    char *line;
+    va_list ap;
+
+    if (!log_started) {         /* writer가 뜨기 전 (시작 시 오류 등): 바로 출력 */
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fputc('\n', stderr);
+        return;
+    }
+    r = get_ring();
+    if (!(line = ring_slot(r)))
+        return;
+    va_start(ap, fmt);
+    end_line(line, vsnprintf(line, LOG_LINE - 1, fmt, ap));
+    va_end(ap);
+    ring_commit(r);
+}
+
+int log_sampled(void)
+{
+    if (!log_started || log_sample <= 0)
+        return 0;
+    return ++get_ring()->seen % log_sample == 0;
+}
+
+void log_access(int fd, const char *method, const char *uri, int status,
+                long bytes, const char *cache, long dur_ns)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    char host[NI_MAXHOST] = "-", port[NI_MAXSERV] = "-", st[16] = "-";
+    struct timespec now;
+
+    if (getpeername(fd, (SA *)&addr, &addrlen) == 0)
+        getnameinfo((SA *)&addr, addrlen, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV);
+    if (status > 0)
+        snprintf(st, sizeof(st), "%d", status);
+    clock_gettime(CLOCK_REALTIME, &now);
+    log_printf("ts=%ld.%03ld client=%s:%s method=%s uri=%s status=%s bytes=%ld "
+               "cache=%s dur_us=%ld",
+               (long)now.tv_sec, now.tv_nsec / 1000000, host, port, method, uri,
+               st, bytes, cache, dur_ns / 1000);
+}
+
+/* 모든 링의 쌓인 줄을 out에 쓴다 */
+static void drain(void)
+{
+    int n = 0;
+
+    for (log_ring_t *r = __atomic_load_n(&all_rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        size_t tail = r->tail;
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+        for (; tail != head; tail++, n++)
+            fputs(r->lines[tail & (LOG_SLOTS - 1)], log_out);
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    if (n)
+        fflush(log_out);
+}
+
+static void *log_writer(void *vargp)
+{
+    struct timespec period = { 0, LOG_FLUSH_MS * 1000000L };
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        int ev = __atomic_load_n(&log_ev, __ATOMIC_ACQUIRE);
+        drain();
+        futex_wait(&log_ev, ev, &period);   /* 그사이 반쯤 찬 링이 있으면 바로 깸 */
+    }
+    return NULL;
+}
+
+void log_init(FILE *out, int sample)
+{
+    pthread_t tid;
+
+    log_out = out;
+    log_sample = sample;
+    pthread_key_create(&ring_key, ring_exit);
+    log_started = 1;
+    Pthread_create(&tid, NULL, log_writer, NULL);
+}
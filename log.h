@@ -0,0 +1,31 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include "csapp.h"
+
+/*
+ * 비동기 로그. 각 스레드는 자기 링에 한 줄을 써 넣기만 하고 (락, stdio,
+ * 시스템 콜 없음), 백그라운드 writer 스레드가 모든 링을 모아 out에 쓴다.
+ * 링이 가득 차면 그 줄은 버리고 log_dropped로 센다 (요청 경로는 막지 않음).
+ *
+ * sample: 접근 로그를 N개 요청마다 한 줄 (1: 전부, 0: 끔)
+ */
+void log_init(FILE *out, int sample);
+
+/* 한 줄 로그 (끝의 \n은 자동으로 붙음) */
+void log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* 이번 접근을 기록할 차례인지 (샘플링). 1이면 log_access를 부를 것 */
+int log_sampled(void);
+
+/*
+ * 구조화된 접근 로그 한 줄 (logfmt):
+ *   ts=<epoch.ms> client=<ip>:<port> method=GET uri=... status=200
+ *   bytes=1234 cache=hit|miss|fast dur_us=...
+ * 클라이언트 주소는 fd에서 숫자로만 얻는다 (역방향 DNS 없음).
+ * status가 0이면 "-" (캐시 히트는 저장된 응답 그대로라 모름)
+ */
+void log_access(int fd, const char *method, const char *uri, int status,
+                long bytes, const char *cache, long dur_ns);
+
+#endif /* __LOG_H__ */
@@ -0,0 +1,332 @@
+/*
+ * origin.c - 프록시 벤치마크/견고성 시험용 합성(synthetic) 원서버
+ *
+ *   usage: ./origin [-s dist] [-M max] [-H header]... [-d ms[:jitter]]
+ *                   [-b rate] [-R p] [-P p] [-L p] [-W ms] [-x seed] <port>
+ *
+ *   -s  객체 크기 분포 (기본 fixed:1k)
+ *         fixed:N              항상 N
+ *         uniform:A:B          A~B 균등
+ *         lognormal:MED:SIGMA  중앙값 MED, ln 표준편차 SIGMA
+ *         pareto:MIN:ALPHA     최소 MIN, 꼬리 지수 ALPHA (작을수록 긴 꼬리)
+ *       크기는 경로를 해시한 값으로 뽑으므로 같은 URI는 항상 같은 크기
+ *       (캐시가 정상 동작하는지 볼 수 있음). 크기에는 k/m을 붙일 수 있다.
+ *   -M  크기 상한 (기본 16m)
+ *   -H  응답에 붙일 헤더 (여러 번 가능, 예: -H "Cache-Control: max-age=60")
+ *   -d  응답 헤더 전 지연 ms (TTFB). ms:jitter 면 ms ± jitter 균등
+ *   -b  연결당 전송 속도 상한 (바이트/초, 예: 1m)
+ *   -R  이 확률로 요청을 읽은 뒤 RST로 끊음 (SO_LINGER 0)
+ *   -P  이 확률로 Content-length보다 짧게 (절반) 보내고 끊음
+ *   -L  이 확률로 slowloris: 응답을 한 바이트씩 -W ms 간격으로 흘림
+ *   -W  slowloris 간격 (기본 100ms)
+ *   -x  난수 씨앗 (기본 1). 고장 주입 결정은 연결 순번과 씨앗으로 정해지므로
+ *       같은 순서로 요청하면 같은 결과가 나온다
+ *
+ *   요청 URI의 질의 문자열로 요청별로 덮어쓸 수 있다:
+ *     ?size=N  &delay=ms  &fault=reset|partial|slow|none
+ *   예: http://localhost:<port>/a.bin?size=200k&fault=partial
+ *
+ *   본문은 경로마다 정해진 바이트 무늬라 받은 쪽에서 내용도 비교할 수 있다.
+ *   응답은 HTTP/1.0, 한 연결에 요청 하나 (Connection: close).
+ *   연결마다 분리(detached) 스레드 하나.
+ */
+#include "csapp.h"
+#include <math.h>
+
+#define OR_MAX_HDRS 16
+#define OR_CHUNK    16384
+
+enum { DIST_FIXED, DIST_UNIFORM, DIST_LOGNORMAL, DIST_PARETO };
+enum { F_NONE, F_RESET, F_PARTIAL, F_SLOW };
+
+/* 설정 (main에서 채운 뒤 읽기만 함) */
+static int dist = DIST_FIXED;
+static double dist_a = 1024, dist_b;
+static long max_size = 16 << 20;
+static char *extra_hdrs[OR_MAX_HDRS];
+static int nextra;
+static long delay_ms, jitter_ms;
+static long rate;               /* 0: 제한 없음 */
+static double p_reset, p_partial, p_slow;
+static long slow_ms = 100;
+static unsigned seed = 1;
+static unsigned long conn_seq;  /* 연결 순번 (원자적) */
+
+static char pattern[OR_CHUNK + 36];    /* 본문 무늬 (오프셋을 달리해 씀) */
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void sleep_ns(long ns)
+{
+    struct timespec ts = { ns / 1000000000L, ns % 1000000000L };
+    if (ns > 0)
+        nanosleep(&ts, NULL);
+}
+
+/* "16k", "1m" 같은 크기 */
+static double parse_size(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    switch (*end) {
+    case 'k': case 'K': v *= 1024; break;
+    case 'm': case 'M': v *= 1024 * 1024; break;
+    case 'g': case 'G': v *= 1024 * 1024 * 1024; break;
+    }
+    return v;
+}
+
+static void parse_dist(char *s)
+{
+    char *name = strtok(s, ":"), *a = strtok(NULL, ":"), *b = strtok(NULL, ":");
+
+    if (!name || !a)
+        app_error("origin: bad -s (fixed:N | uniform:A:B | lognormal:MED:SIGMA | pareto:MIN:ALPHA)");
+    dist_a = parse_size(a);
+    if (!strcmp(name, "fixed"))
+        dist = DIST_FIXED;
+    else if (!strcmp(name, "uniform") && b)
+        dist = DIST_UNIFORM, dist_b = parse_size(b);
+    else if (!strcmp(name, "lognormal") && b)
+        dist = DIST_LOGNORMAL, dist_b = atof(b);
+    else if (!strcmp(name, "pareto") && b)
+        dist = DIST_PARETO, dist_b = atof(b);
+    else
+        app_error("origin: bad -s (fixed:N | uniform:A:B | lognormal:MED:SIGMA | pareto:MIN:ALPHA)");
+}
+
+/* FNV-1a 64비트 */
+static unsigned long hash_str(const char *s)
+{
+    unsigned long h = 14695981039346656037UL;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211UL;
+    return h;
+}
+
+/* 64비트 값 하나로 (0,1) 균등 난수 두 개 */
+static void unit_pair(unsigned long h, double *u1, double *u2)
+{
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdUL; h ^= h >> 33;
+    *u1 = ((h >> 32) + 0.5) / 4294967296.0;
+    *u2 = ((h & 0xffffffffUL) + 0.5) / 4294967296.0;
+}
+
+/* 경로에 대해 항상 같은 크기 */
+static long object_size(const char *path)
+{
+    double u1, u2, v;
+
+    unit_pair(hash_str(path) ^ seed, &u1, &u2);
+    switch (dist) {
+    case DIST_UNIFORM:
+        v = dist_a + u1 * (dist_b - dist_a + 1);
+        break;
+    case DIST_LOGNORMAL:    /* Box-Muller */
+        v = dist_a * exp(dist_b * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+        break;
+    case DIST_PARETO:
+        v = dist_a / pow(u1, 1.0 / dist_b);
+        break;
+    default:
+        v = dist_a;
+    }
+    if (v < 0)
+        v = 0;
+    return v > max_size ? max_size : (long)v;
+}
+
+/* 질의 문자열 "a=1&b=2"에서 key의 값 (없으면 NULL). 값은 '&'나 끝까지 */
+static char *query_get(char *query, const char *key, char *val, size_t len)
+{
+    size_t klen = strlen(key);
+    char *p = query;
+
+    while (p && *p) {
+        if (!strncmp(p, key, klen) && p[klen] == '=') {
+            size_t n = strcspn(p + klen + 1, "&");
+            if (n >= len)
+                n = len - 1;
+            memcpy(val, p + klen + 1, n);
+            val[n] = '\0';
+            return val;
+        }
+        if ((p = strchr(p, '&')) != NULL)
+            p++;
+    }
+    return NULL;
+}
+
+/*
+ * 속도 상한을 지키며 쓰기. 보낸 양이 경과 시간 × rate를 넘으면 잔다.
+ * slow면 한 바이트씩 slow_ms 간격. 실패하면 -1 (상대가 끊음)
+ */
+static int send_paced(int fd, const char *buf, long n, long t0, long *sent, int slow)
+{
+    while (n > 0) {
+        long chunk = slow ? 1 : (n < OR_CHUNK ? n : OR_CHUNK);
+
+        if (slow)
+            sleep_ns(slow_ms * 1000000L);
+        else if (rate)
+            sleep_ns((long)(*sent * 1e9 / rate) - (now_ns() - t0));
+        if (rio_writen(fd, (void *)buf, chunk) < 0)
+            return -1;
+        buf += chunk;
+        n -= chunk;
+        *sent += chunk;
+    }
+    return 0;
+}
+
+static void serve(int fd)
+{
+    rio_t rio;
+    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char hdr[MAXBUF], val[64], *path, *query;
+    unsigned long seq = __atomic_fetch_add(&conn_seq, 1, __ATOMIC_RELAXED);
+    unsigned rs = seed * 2654435761u + (unsigned)seq;
+    int fault = F_NONE, n;
+    long size, delay, t0, sent = 0;
+    double r;
+
+    rio_readinitb(&rio, fd);
+    if (rio_readlineb(&rio, buf, MAXLINE) <= 0)
+        return;
+    if (sscanf(buf, "%s %s %s", method, uri, version) != 3)
+        return;
+    while ((n = rio_readlineb(&rio, buf, MAXLINE)) > 0 && strcmp(buf, "\r\n"))
+        ;
+
+    /* 절대 URI면 경로만 */
+    path = uri;
+    if (!strncasecmp(path, "http://", 7) && (path = strchr(path + 7, '/')) == NULL)
+        path = "/";
+    if ((query = strchr(path, '?')) != NULL)
+        *query++ = '\0';
+
+    /* 고장 주입: 연결마다 정해진 난수 하나로 고른다 */
+    r = rand_r(&rs) / (RAND_MAX + 1.0);
+    if (r < p_reset)
+        fault = F_RESET;
+    else if ((r -= p_reset) < p_partial)
+        fault = F_PARTIAL;
+    else if ((r -= p_partial) < p_slow)
+        fault = F_SLOW;
+
+    size = object_size(path);
+    delay = delay_ms + (jitter_ms ? (long)(rand_r(&rs) % (2 * jitter_ms + 1)) - jitter_ms : 0);
+    if (query_get(query, "size", val, sizeof(val)))
+        size = (long)parse_size(val);
+    if (query_get(query, "delay", val, sizeof(val)))
+        delay = atol(val);
+    if (query_get(query, "fault", val, sizeof(val)))
+        fault = !strcmp(val, "reset") ? F_RESET : !strcmp(val, "partial") ? F_PARTIAL :
+                !strcmp(val, "slow") ? F_SLOW : F_NONE;
+
+    if (fault == F_RESET) {
+        /* 닫을 때 FIN 대신 RST */
+        struct linger lg = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        return;
+    }
+
+    sleep_ns(delay * 1000000L);
+
+    n = snprintf(hdr, sizeof(hdr),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Server: Synthetic Origin\r\n"
+                 "Connection: close\r\n"
+                 "Content-type: application/octet-stream\r\n"
+                 "Content-length: %ld\r\n", size);
+    for (int i = 0; i < nextra && n < (int)sizeof(hdr); i++)
+        n += snprintf(hdr + n, sizeof(hdr) - n, "%s\r\n", extra_hdrs[i]);
+    if (n < (int)sizeof(hdr))
+        n += snprintf(hdr + n, sizeof(hdr) - n, "\r\n");
+    if (n >= (int)sizeof(hdr))
+        return;
+
+    t0 = now_ns();
+    if (send_paced(fd, hdr, n, t0, &sent, fault == F_SLOW) < 0)
+        return;
+
+    /* 본문: 경로 해시로 정한 오프셋부터 무늬를 이어 씀 */
+    long off = hash_str(path) % 36, left = fault == F_PARTIAL ? size / 2 : size;
+    while (left > 0) {
+        long chunk = left < OR_CHUNK ? left : OR_CHUNK;
+        if (send_paced(fd, pattern + off, chunk, t0, &sent, fault == F_SLOW) < 0)
+            return;
+        left -= chunk;
+        off = (off + chunk) % 36;
+    }
+}
+
+static void *thread(void *vargp)
+{
+    int fd = (int)(long)vargp;
+
+    Pthread_detach(pthread_self());
+    serve(fd);
+    close(fd);
+    return NULL;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ./origin [-s dist] [-M max] [-H header]... [-d ms[:jitter]]\n"
+                    "                [-b rate] [-R p] [-P p] [-L p] [-W ms] [-x seed] <port>\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    pthread_t tid;
+    char *colon;
+    int listenfd, connfd, c;
+
+    while ((c = getopt(argc, argv, "s:M:H:d:b:R:P:L:W:x:")) != -1) {
+        switch (c) {
+        case 's': parse_dist(optarg); break;
+        case 'M': max_size = (long)parse_size(optarg); break;
+        case 'H':
+            if (nextra == OR_MAX_HDRS)
+                app_error("origin: too many -H");
+            extra_hdrs[nextra++] = optarg;
+            break;
+        case 'd':
+            delay_ms = atol(optarg);
+            if ((colon = strchr(optarg, ':')) != NULL)
+                jitter_ms = atol(colon + 1);
+            break;
+        case 'b': rate = (long)parse_size(optarg); break;
+        case 'R': p_reset = atof(optarg); break;
+        case 'P': p_partial = atof(optarg); break;
+        case 'L': p_slow = atof(optarg); break;
+        case 'W': slow_ms = atol(optarg); break;
+        case 'x': seed = strtoul(optarg, NULL, 10); break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+
+    for (int i = 0; i < (int)sizeof(pattern); i++)
+        pattern[i] = "0123456789abcdefghijklmnopqrstuvwxyz"[i % 36];
+
+    Signal(SIGPIPE, SIG_IGN);   // 끊은 클라이언트에 쓰다가 죽지 않도록
+    listenfd = Open_listenfd(argv[optind]);
+    while (1) {
+        addrlen = sizeof(addr);
+        if ((connfd = accept(listenfd, (SA *)&addr, &addrlen)) < 0)
+            continue;
+        Pthread_create(&tid, NULL, thread, (void *)(long)connfd);
+    }
+}
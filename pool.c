@@ -0,0 +1,342 @@
+/*
+ * pool.c - 연결을 워커 스레드에 나눠주는 워커 풀
+ *
+ * 공유 큐 모드 (기본): 큐 하나를 모든 워커가 나눠 쓰고, 큐 깊이/대기
+ *   시간에 따라 워커 수가 늘었다 줄었다 한다.
+ *   늘리기: 연결을 넣을 때 큐가 grow_depth 이상 쌓였거나, 워커가 꺼낸
+ *           연결이 grow_wait_us보다 오래 기다렸는데 노는 워커가 없으면
+ *           max_threads까지 하나씩 추가한다.
+ *   줄이기: min_threads를 넘는 워커는 idle_ms 동안 일이 없으면 종료한다.
+ *
+ * 작업 훔치기 모드 (steal): 워커마다 자기 큐를 갖는다. acceptor는
+ *   라운드 로빈으로 넣고, 자기 큐가 빈 워커는 이웃 큐에서 훔쳐 온다.
+ *   모두 비었으면 공용 futex에서 잠들고, acceptor가 깨운다.
+ *   워커 큐가 워커에 묶여 있으므로 워커 수는 min_threads로 고정이다.
+ */
+#include "pool.h"
+#include "sbuf.h"
+#include "stats.h"
+#include "futex.h"
+#include <sys/resource.h>
+
+static pool_conf_t pool_conf;
+static pool_handler_t pool_handler;
+
+/* 공유 큐 모드 */
+static sbuf_t pool_queue;
+static int nthreads;        /* 현재 워커 수 */
+static int nidle;           /* 큐에서 일을 기다리는 워커 수 */
+static int nspawned;        /* 지금까지 만든 워커 수 (CPU 고정 번호) */
+
+/* 작업 훔치기 모드 */
+static sbuf_t *wqueues;     /* wqueues[i]: i번 워커의 큐 */
+static int nqueues;
+static unsigned rr_next;    /* 다음에 넣을 큐 (acceptor와 fast lane이 공유) */
+static int park_ev;         /* 잠든 워커가 있을 때 연결을 넣으면 증가 */
+static int nparked;         /* 모든 큐가 비어 잠든 워커 수 */
+
+/* enq_ns[fd]: 연결이 큐에 들어간 시각 (fd는 열려 있는 동안 유일) */
+static long *enq_ns;
+static int enq_max;
+
+/* 최근 연결 처리 시간의 지수 이동 평균 (ns, 입장 제어의 대기 예측용) */
+static long svc_ewma_ns;
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void *pool_worker(void *vargp);
+
+/* 워커 하나 추가 시도 (max에 도달했거나 생성 실패면 0) */
+static int pool_grow(void)
+{
+    pthread_t tid;
+    int n = __atomic_load_n(&nthreads, __ATOMIC_RELAXED);
+
+    do {
+        if (n >= pool_conf.max_threads)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&nthreads, &n, n + 1, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    long id = __atomic_fetch_add(&nspawned, 1, __ATOMIC_RELAXED);
+    if (pthread_create(&tid, NULL, pool_worker, (void *)id) != 0) {
+        __atomic_fetch_sub(&nthreads, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    stats_inc(STAT_POOL_THREADS);
+    return 1;
+}
+
+/* 유휴 워커 하나가 종료해도 되는지 확인하고 자리를 반납 */
+static int pool_shrink(void)
+{
+    int n = __atomic_load_n(&nthreads, __ATOMIC_RELAXED);
+
+    do {
+        if (n <= pool_conf.min_threads)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&nthreads, &n, n - 1, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    stats_add(STAT_POOL_THREADS, -1);
+    return 1;
+}
+
+/* 큐 대기 시간을 기록하고 연결을 처리. 대기 시간을 리턴 */
+static long run_conn(int connfd)
+{
+    long wait = connfd < enq_max ? now_ns() - enq_ns[connfd] : 0;
+
+    stats_observe(HIST_QUEUE_WAIT, wait);
+    long start = now_ns();
+    pool_handler(connfd);
+    /* 여러 워커가 겹쳐 써도 추정치라 상관없다: ewma += (x - ewma) / 8 */
+    long ewma = __atomic_load_n(&svc_ewma_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&svc_ewma_ns, ewma + (now_ns() - start - ewma) / 8,
+                     __ATOMIC_RELAXED);
+    return wait;
+}
+
+/* 공유 큐 모드의 워커 루프 */
+static void shared_loop(void)
+{
+    int connfd;
+
+    while (1) {
+        __atomic_fetch_add(&nidle, 1, __ATOMIC_RELAXED);
+        stats_inc(STAT_POOL_IDLE);
+        int got = sbuf_remove_timed(&pool_queue, &connfd, pool_conf.idle_ms);
+        __atomic_fetch_sub(&nidle, 1, __ATOMIC_RELAXED);
+        stats_add(STAT_POOL_IDLE, -1);
+
+        if (!got) {
+            if (pool_shrink()) {
+                stats_inc(STAT_POOL_SHRINK);
+                return;
+            }
+            continue;
+        }
+
+        /* 너무 오래 기다렸고 노는 워커가 없으면 하나 더 */
+        long wait = run_conn(connfd);
+        if (wait > pool_conf.grow_wait_us * 1000 &&
+            __atomic_load_n(&nidle, __ATOMIC_RELAXED) == 0 && pool_grow())
+            stats_inc(STAT_POOL_GROW);
+    }
+}
+
+/* 자기 큐 먼저, 비었으면 이웃 큐를 차례로 훔쳐본다 */
+static int steal_take(int id, int *connfd)
+{
+    if (sbuf_try_remove(&wqueues[id], connfd))
+        return 1;
+    for (int k = 1; k < nqueues; k++) {
+        if (sbuf_try_remove(&wqueues[(id + k) % nqueues], connfd)) {
+            stats_inc(STAT_POOL_STEAL);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* 작업 훔치기 모드의 워커 루프 */
+static void steal_loop(int id)
+{
+    int connfd;
+
+    while (1) {
+        if (!steal_take(id, &connfd)) {
+            /* 잠들기 전에 한 번 더 확인 (sbuf_remove와 같은 방식) */
+            __atomic_fetch_add(&nparked, 1, __ATOMIC_SEQ_CST);
+            stats_inc(STAT_POOL_IDLE);
+            int ev = __atomic_load_n(&park_ev, __ATOMIC_SEQ_CST);
+            int got = steal_take(id, &connfd);
+            if (!got)
+                futex_wait(&park_ev, ev, NULL);
+            __atomic_fetch_sub(&nparked, 1, __ATOMIC_SEQ_CST);
+            stats_add(STAT_POOL_IDLE, -1);
+            if (!got)
+                continue;
+        }
+        run_conn(connfd);
+    }
+}
+
+/*
+ * 워커를 CPU (id % ncpu)에 고정.
+ * cpu_set_t/pthread_setaffinity_np는 _GNU_SOURCE가 필요한데, 그러면
+ * csapp.h의 gai_error가 glibc 선언과 충돌하므로 시스템 콜을 직접 쓴다.
+ */
+static void pin_to_cpu(long id)
+{
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {0};
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    long cpu = id % (ncpu > 0 ? ncpu : 1) % 1024;
+
+    mask[cpu / (8 * sizeof(unsigned long))] |= 1UL << (cpu % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) < 0)   /* 0: 호출한 스레드 */
+        fprintf(stderr, "pool: cannot pin worker %ld: %s\n", id, strerror(errno));
+}
+
+static void *pool_worker(void *vargp)
+{
+    long id = (long)vargp;
+
+    Pthread_detach(pthread_self());
+    if (pool_conf.pin)
+        pin_to_cpu(id);
+    if (pool_conf.steal)
+        steal_loop(id);
+    else
+        shared_loop();
+    return NULL;
+}
+
+void pool_conf_default(pool_conf_t *conf)
+{
+    conf->min_threads = 4;
+    conf->max_threads = 64;
+    conf->qsize = 16;
+    conf->grow_depth = 4;
+    conf->grow_wait_us = 1000;
+    conf->idle_ms = 5000;
+    conf->steal = 0;
+    conf->pin = 0;
+}
+
+void pool_init(const pool_conf_t *conf, pool_handler_t handler)
+{
+    struct rlimit rl;
+
+    pool_conf = *conf;
+    if (pool_conf.min_threads < 1)
+        pool_conf.min_threads = 1;
+    if (pool_conf.max_threads < pool_conf.min_threads || pool_conf.steal)
+        pool_conf.max_threads = pool_conf.min_threads;
+    pool_handler = handler;
+
+    /* 열 수 있는 fd 개수만큼 타임스탬프 칸을 마련 */
+    enq_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+              ? rl.rlim_cur : 65536;
+    enq_ns = Calloc(enq_max, sizeof(long));
+
+    if (pool_conf.steal) {
+        nqueues = pool_conf.min_threads;
+        wqueues = Calloc(nqueues, sizeof(sbuf_t));
+        for (int i = 0; i < nqueues; i++)
+            sbuf_init(&wqueues[i], pool_conf.qsize);
+    } else {
+        sbuf_init(&pool_queue, pool_conf.qsize);
+    }
+    for (int i = 0; i < pool_conf.min_threads; i++)
+        if (!pool_grow())
+            app_error("pool_init: cannot create worker threads");
+}
+
+/*
+ * 작업 훔치기 모드: 라운드 로빈으로 넣고, 잠든 워커가 있으면 깨운다.
+ * 모든 큐가 가득 찼을 때 block이 0이면 넣지 않고 0을 리턴.
+ */
+static int steal_submit(int connfd, int block)
+{
+    int start = __atomic_fetch_add(&rr_next, 1, __ATOMIC_RELAXED) % nqueues, k;
+
+    for (k = 0; k < nqueues; k++)
+        if (sbuf_try_insert(&wqueues[(start + k) % nqueues], connfd))
+            break;
+    if (k == nqueues) {              /* 모든 큐가 가득 참: 자리가 날 때까지 */
+        if (!block)
+            return 0;
+        sbuf_insert(&wqueues[start], connfd);
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&nparked, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&park_ev, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&park_ev, 1);
+    }
+    return 1;
+}
+
+/* pool_submit/pool_try_submit 공통: block이 0이면 가득 찼을 때 0 리턴 */
+static int submit(int connfd, int block)
+{
+    if (connfd < enq_max)
+        enq_ns[connfd] = now_ns();  /* sbuf의 release 저장으로 워커에 보임 */
+
+    if (pool_conf.steal)
+        return steal_submit(connfd, block);
+
+    if (!sbuf_try_insert(&pool_queue, connfd)) {
+        /* 가득 참: 워커를 늘려보고 자리가 날 때까지 대기 */
+        if (pool_grow())
+            stats_inc(STAT_POOL_GROW);
+        if (!block)
+            return sbuf_try_insert(&pool_queue, connfd);
+        sbuf_insert(&pool_queue, connfd);
+        return 1;
+    }
+    if (sbuf_count(&pool_queue) >= pool_conf.grow_depth &&
+        __atomic_load_n(&nidle, __ATOMIC_RELAXED) == 0 && pool_grow())
+        stats_inc(STAT_POOL_GROW);
+    return 1;
+}
+
+void pool_submit(int connfd)
+{
+    submit(connfd, 1);
+}
+
+int pool_try_submit(int connfd)
+{
+    return submit(connfd, 0);
+}
+
+/* q의 맨 앞 연결이 지금까지 기다린 시간 */
+static long head_age(sbuf_t *q, long now)
+{
+    int fd;
+
+    if (!sbuf_peek(q, &fd) || fd < 0 || fd >= enq_max)
+        return 0;
+    long age = now - __atomic_load_n(&enq_ns[fd], __ATOMIC_RELAXED);
+    return age > 0 ? age : 0;
+}
+
+long pool_queue_depth(void)
+{
+    long depth = 0;
+
+    if (!pool_conf.steal)
+        return sbuf_count(&pool_queue);
+    for (int i = 0; i < nqueues; i++)
+        depth += sbuf_count(&wqueues[i]);
+    return depth;
+}
+
+/*
+ * 맨 앞 연결의 대기 시간만 보면 한꺼번에 몰려온 연결은 아직 아무도
+ * 오래 기다리지 않아 전부 통과한다. 그래서 (큐 길이 x 최근 처리 시간
+ * / 워커 수)로 새 연결이 기다릴 시간도 예측해 둘 중 큰 값을 쓴다.
+ */
+long pool_queue_wait(void)
+{
+    long now = now_ns(), age = 0, a, depth = pool_queue_depth();
+    int workers;
+
+    if (!pool_conf.steal) {
+        age = head_age(&pool_queue, now);
+        workers = __atomic_load_n(&nthreads, __ATOMIC_RELAXED);
+    } else {
+        for (int i = 0; i < nqueues; i++)
+            if ((a = head_age(&wqueues[i], now)) > age)
+                age = a;
+        workers = nqueues;
+    }
+    long predict = workers > 0 ?
+        depth * __atomic_load_n(&svc_ewma_ns, __ATOMIC_RELAXED) / workers : 0;
+    return predict > age ? predict : age;
+}
@@ -0,0 +1,42 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include "csapp.h"
+
+/* 워커가 연결 하나를 처리하는 함수 (connfd를 닫는 것까지 책임진다) */
+typedef void (*pool_handler_t)(int connfd);
+
+/* 워커 풀 설정 */
+typedef struct {
+    int min_threads;      /* 항상 유지할 워커 수 */
+    int max_threads;      /* 늘어날 수 있는 최대 워커 수 */
+    int qsize;            /* 공유 버퍼(큐) 크기 */
+    int grow_depth;       /* 큐에 이만큼 쌓이면 워커 추가 */
+    long grow_wait_us;    /* 큐 대기 시간이 이보다 길면 워커 추가 */
+    int idle_ms;          /* 이만큼 일이 없으면 (min 초과분) 워커 종료 */
+    int steal;            /* 1이면 워커별 큐 + 작업 훔치기 (워커 수는 min_threads로 고정) */
+    int pin;              /* 1이면 i번째 워커를 CPU (i % ncpu)에 고정 */
+} pool_conf_t;
+
+/* 기본 설정으로 채움 */
+void pool_conf_default(pool_conf_t *conf);
+
+/* min_threads개의 워커를 띄우고 handler로 연결을 처리 */
+void pool_init(const pool_conf_t *conf, pool_handler_t handler);
+
+/* 연결을 큐에 넣음 (가득 차 있으면 워커를 늘려보고, 그래도 안 되면 대기) */
+void pool_submit(int connfd);
+
+/* 잠들지 않는 버전: 큐가 가득 차서 못 넣었으면 0 */
+int pool_try_submit(int connfd);
+
+/*
+ * 지금 들어오는 연결이 큐에서 기다릴 시간 추정 (ns) - 입장 제어용.
+ * 맨 앞 연결이 이미 기다린 시간과 (큐 길이 x 최근 처리 시간 / 워커 수) 중 큰 값
+ */
+long pool_queue_wait(void);
+
+/* 큐(들)에 쌓인 연결 수 - /metrics 샘플러용 */
+long pool_queue_depth(void);
+
+#endif /* __POOL_H__ */
@@ -1,142 +1,606 @@
 #include "csapp.h"
 #include "cache.h"
-#include "sbuf.h"
+#include "pool.h"
+#include "fastlane.h"
+#include "coro.h"
+#include "stats.h"
+#include "admit.h"
+#include "bufpool.h"
+#include "log.h"
+#include "admin.h"
+#include "trace.h"
+#include "range.h"
+#include <limits.h>
 
 /* 권장되는 최대 캐시 및 객체 크기 */
 #define MAX_CACHE_SIZE 1049000
 #define MAX_OBJECT_SIZE 102400
+#define MAX_HEADER_SIZE 65536   // [수정] 클라이언트 요청 헤더의 최대 크기 (넘으면 431)
 
-#define NTHREADS  6  // 워커 스레드 수
-#define SBUFSIZE 16  // 공유 버퍼(큐) 크기
-
-sbuf_t sbuf; // 공유 버퍼 전역 변수
+#define NTHREADS      6  // 기본(최소) 워커 스레드 수
+#define NTHREADS_MAX 64  // 부하가 몰릴 때 늘어날 수 있는 최대 워커 수
+#define SBUFSIZE     16  // 공유 버퍼(큐) 크기
+#define NFASTLANES    1  // 캐시 히트를 바로 처리하는 fast lane 스레드 수
 
 /* 제공된 User-Agent 헤더 상수 */
 static const char *user_agent_hdr =
         "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
         "Firefox/10.0.3\r\n";
+/* [수정] 접근 로그 한 줄에 들어갈 요청 결과 (doit이 채움) */
+typedef struct {
+    char method[16];
+    char uri[MAXLINE];
+    int status;         /* 클라이언트에 보낸 상태 코드 (0: 모름) */
+    long bytes;         /* 클라이언트에 보낸 응답 바이트 */
+    const char *cache;  /* "hit", "miss" 또는 "-" */
+} access_t;
+
 /* BASIC */
-void doit(int fd);
-void parse_uri(char *uri, char *host, char *port, char *path);
+void doit(int fd, access_t *acc);
+int parse_uri(char *uri, char *host, char *port, const char **path);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
 
 /* Concurrency */
-void *thread_function(void *vargp);
+void handle_conn(int connfd);
+static void usage(char *prog);
+static void metrics_handler(FILE *fp, const char *query);
+static void trace_handler(FILE *fp, const char *query);
+static void submit_admit(int connfd);
+
+/* 연결을 넘길 곳: 워커 풀 (기본) 또는 코루틴 런타임 (-c) */
+static void (*submit)(int) = pool_submit;
+static int (*try_submit)(int) = pool_try_submit;
 
 /*
  * main - 프록시의 메인 루틴. (동시성 적용)
  */
 int main(int argc, char **argv) {
     int listenfd, connfd;
-    char hostname[MAXLINE], port[MAXLINE];
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;
-    pthread_t tid;
-
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
-        exit(1);
+    pool_conf_t conf;
+    admit_conf_t aconf = { 0, 0 };
+    int nlanes = NFASTLANES;
+    int nsched = 0;
+    int log_every = 1;
+    char *admin_port = NULL;
+    int c;
+
+    /* [수정] 워커 풀 크기/임계값은 옵션으로 조정 */
+    pool_conf_default(&conf);
+    conf.min_threads = NTHREADS;
+    conf.max_threads = NTHREADS_MAX;
+    conf.qsize = SBUFSIZE;
+    while ((c = getopt(argc, argv, "t:T:q:d:w:i:spf:c:S:I:l:a:r")) != -1) {
+        switch (c) {
+        case 't': conf.min_threads = atoi(optarg); break;
+        case 'T': conf.max_threads = atoi(optarg); break;
+        case 'q': conf.qsize = atoi(optarg); break;
+        case 'd': conf.grow_depth = atoi(optarg); break;
+        case 'w': conf.grow_wait_us = atol(optarg); break;
+        case 'i': conf.idle_ms = atoi(optarg); break;
+        case 's': conf.steal = 1; break;   /* 워커별 큐 + 작업 훔치기 */
+        case 'p': conf.pin = 1; break;     /* 워커를 CPU에 고정 */
+        case 'f': nlanes = atoi(optarg); break;
+        case 'c': nsched = atoi(optarg); break;
+        case 'S': aconf.slo_ms = atol(optarg); break;     /* 큐 대기 SLO */
+        case 'I': aconf.per_ip_max = atoi(optarg); break; /* IP당 동시 연결 */
+        case 'l': log_every = atoi(optarg); break;        /* 접근 로그 샘플링 */
+        case 'a': admin_port = optarg; break;             /* /metrics 포트 */
+        case 'r': trace_init(); break;                    /* 연결 수명 추적 */
+        default: usage(argv[0]);
+        }
     }
+    if (optind != argc - 1)
+        usage(argv[0]);
 
     Signal(SIGPIPE, SIG_IGN);
+    stats_start_dumper(); /* kill -USR1 <pid> 로 오류 카운터 확인 */
+    log_init(stdout, log_every); /* [수정] stdout 출력은 writer 스레드가 모아서 */
     cache_init();
 
-    /* [수정] 스레드 풀 초기화 */
-    sbuf_init(&sbuf, SBUFSIZE);
-    listenfd = Open_listenfd(argv[1]);
+    listenfd = Open_listenfd(argv[optind]);
 
-    /* [수정] NTHREADS 개의 워커 스레드를 미리 생성 */
-    for (int i = 0; i < NTHREADS; i++) {
-        Pthread_create(&tid, NULL, thread_function, NULL);
+    if (nsched > 0) {
+        /* [수정] 코루틴 모드: 연결마다 코루틴, nsched개의 스레드가 epoll로 돌림 */
+        coro_init(nsched, handle_conn);
+        submit = coro_submit;
+        try_submit = coro_try_submit;
+    } else {
+        /* [수정] 최소 개수의 워커를 미리 만들고, 큐 상태에 따라 늘리고 줄임 */
+        pool_init(&conf, handle_conn);
+    }
+    /* [수정] 코루틴 모드는 큐에 쌓이지 않으므로 SLO 검사는 워커 풀에서만 */
+    admit_init(&aconf, nsched > 0 ? NULL : pool_queue_wait);
+    /* [수정] 캐시 히트는 fast lane에서 큐를 거치지 않고 바로 응답 */
+    if (nlanes > 0)
+        fastlane_init(nlanes, submit_admit, try_submit, admit_slo);
+    /* [수정] 관리 포트: 스크레이프할 때만 스레드별 통계를 합쳐서 내보냄 */
+    if (admin_port) {
+        if (nsched == 0)
+            stats_set_sampler(STAT_QUEUE_DEPTH, pool_queue_depth);
+        admin_route("/metrics", "text/plain; version=0.0.4", metrics_handler);
+        admin_route("/trace", "application/json", trace_handler);
+        admin_start(admin_port);
     }
 
     /* [수정] main 스레드는 이제 '생산자' 역할만 수행 */
     while (1) {
         clientlen = sizeof(clientaddr);
-        connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-        Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
-        printf("Accepted connection from (%s, %s)\n", hostname, port);
+        /*
+         * [수정] Accept 래퍼는 실패 시 exit()하므로 직접 accept 호출.
+         * ECONNABORTED 등은 해당 연결만 포기하고 계속 진행.
+         * [수정] EMFILE/ENFILE이면 backlog를 하나 비우고 잠깐 쉰다.
+         */
+        if ((connfd = accept(listenfd, (SA *)&clientaddr, &clientlen)) < 0) {
+            int err = errno;
+            stats_inc(STAT_ACCEPT_ERR);
+            log_printf("accept error: %s", strerror(err));
+            admit_accept_error(listenfd, err);
+            continue;
+        }
+        admit_accept_ok();
+        stats_inc(STAT_CONN_ACCEPTED);
+        /*
+         * [수정] 연결마다 하던 getnameinfo(역방향 DNS) + printf는 없앴다.
+         * 클라이언트 주소는 접근 로그에 숫자로만 남는다 (log_access).
+         */
+
+        /*
+         * [수정] IP별 상한이면 바로 503. 큐 대기 SLO는 워커 풀에 넘길 때
+         * (submit_admit) 검사하므로 캐시 히트는 막히지 않는다.
+         */
+        if (!admit_conn(connfd, &clientaddr))
+            continue;
+        trace_accept(connfd);
 
-        /* connfd를 공유 버퍼에 삽입 */
-        sbuf_insert(&sbuf, connfd);
+        /* connfd를 fast lane(히트 확인) 또는 워커 풀/코루틴 런타임에 넘김 */
+        if (nlanes > 0)
+            fastlane_submit(connfd);
+        else
+            submit_admit(connfd);
     }
 }
 
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-t min_threads] [-T max_threads] [-q queue_size]\n"
+                    "       [-d grow_depth] [-w grow_wait_us] [-i idle_ms] [-s] [-p]\n"
+                    "       [-f fast_lanes] [-c coro_threads] [-S slo_ms] [-I per_ip]\n"
+                    "       [-l log_every] [-a admin_port] [-r] <port>\n"
+                    "  -s  per-worker queues with work stealing (fixed at min_threads)\n"
+                    "  -p  pin workers to CPUs\n"
+                    "  -f  threads answering cache hits ahead of the queue (0: off)\n"
+                    "  -c  run each connection as a coroutine on this many threads\n"
+                    "      instead of the worker pool\n"
+                    "  -S  reply 503 to a connection headed for the worker queue\n"
+                    "      when its predicted wait, max(oldest queued age,\n"
+                    "      depth x avg service time / workers), exceeds this\n"
+                    "      many ms (0: off; fast-lane cache hits are never shed)\n"
+                    "  -I  max concurrent connections per client IP (0: no cap)\n"
+                    "  -l  write an access log line for every Nth request\n"
+                    "      (1: all, 0: off)\n"
+                    "  -a  serve Prometheus metrics at /metrics on this port\n"
+                    "  -r  record connection events; dump Chrome trace JSON\n"
+                    "      from /trace on the admin port\n", prog);
+    exit(1);
+}
+
+/*
+ * [수정] 워커 풀/코루틴 런타임에 넘기기 직전에 SLO 검사 (fast lane이 바로
+ * 넘기는 연결. 대기 목록을 거치는 연결은 fast lane이 admit_slo를 한 번만 부름)
+ */
+static void submit_admit(int connfd) {
+    if (admit_slo(connfd))
+        submit(connfd);
+}
+
+/* 관리 포트 GET /metrics */
+static void metrics_handler(FILE *fp, const char *query) {
+    stats_prometheus(fp);
+}
+
+/* 관리 포트 GET /trace (-r 일 때만 이벤트가 있음) */
+static void trace_handler(FILE *fp, const char *query) {
+    trace_dump(fp);
+}
+
 /*
- * 스레드의 메인 루틴 (시작 함수)
+ * handle_conn - 워커 스레드가 꺼낸 연결 하나를 처리 (pool_handler_t)
  */
-void *thread_function(void *vargp) {
+void handle_conn(int connfd) {
+    access_t acc = { .status = 0, .bytes = 0, .cache = "-" };
+    long t0 = stats_now_ns(), dur;
 
-    // 1. 스레드를 분리(detach)하여 자원을 자동 해제
-    Pthread_detach(pthread_self());
+    acc.method[0] = '\0';
+    trace_ev(connfd, TR_DEQUEUE);
 
-    // 2. 워커 스레드는 무한 루프를 돌며 작업을 기다림
-    while (1) {
-        /* 공유 버퍼에서 connfd를 꺼냄 (없으면 대기) */
-        int connfd = sbuf_remove(&sbuf);
+    /* 핵심 로직 수행 */
+    doit(connfd, &acc);
+
+    /* [수정] 요청을 읽은 경우만 전체 시간을 기록 */
+    dur = stats_now_ns() - t0;
+    if (acc.method[0])
+        stats_observe(HIST_TOTAL, dur);
+    stats_add(STAT_BYTES_SENT, acc.bytes);
+
+    /* [수정] 접근 로그: 요청을 읽은 경우만, 샘플링해서 (링에 넣기만 함) */
+    if (acc.method[0] && log_sampled())
+        log_access(connfd, acc.method, acc.uri, acc.status, acc.bytes, acc.cache, dur);
+
+    /* 연결 종료 (IP별 연결 수 반납 포함) */
+    admit_close(connfd);
+}
+
+/*
+ * resp_status - 응답 첫 조각("HTTP/1.x NNN ...")에서 상태 코드 (모르면 0)
+ */
+static int resp_status(const char *p, ssize_t n) {
+    const char *sp = memchr(p, ' ', n);
+
+    if (n < 12 || memcmp(p, "HTTP/", 5) || !sp || p + n - sp < 4)
+        return 0;
+    if (!isdigit((unsigned char) sp[1]) || !isdigit((unsigned char) sp[2]) ||
+        !isdigit((unsigned char) sp[3]))
+        return 0;
+    return (sp[1] - '0') * 100 + (sp[2] - '0') * 10 + (sp[3] - '0');
+}
+
+/*
+ * [수정] 바이트 구간 (Range) 응답
+ *
+ * 전체가 캐시된 객체 (상태 200) 는 캐시의 본문에서 구간만 잘라 206으로.
+ * 캐시에 다 못 들어가는 큰 객체 (미디어) 는 SEG_SIZE 블록 단위로
+ * "uri seg=<i>" 에, 전체 크기와 Content-type은 "uri meta" 에 넣어 두고,
+ * 필요한 블록이 다 있으면 블록들에서 206을 만든다. 하나라도 없으면
+ * 원서버로 보낸다 (구간 하나면 블록 경계로 넓혀서 받아 와 블록째 캐시에
+ * 넣고, 요청한 부분만 돌려준다).
+ * [수정] 키의 구분자는 공백 - 요청 라인의 URI에는 공백이 들어갈 수 없으므로
+ * 클라이언트가 "uri#seg=0" 같은 URI로 블록/메타 항목을 꺼내거나 덮지 못한다.
+ */
+#define SEG_SIZE      (64 * 1024)
+#define SEG_FETCH_MAX 16            /* 한 번에 넓혀 받아 올 최대 블록 수 */
+#define RANGE_BUF_MAX (SEG_FETCH_MAX * SEG_SIZE + MAXBUF)   /* 구간 응답을 모아 둘 최대 크기 */
+#define SEG_BLOCKS    32            /* 캐시에서 한 요청에 모을 최대 블록 수 */
+
+/* 응답 data[0..len)의 본문 시작 오프셋 (헤더가 안 끝났으면 -1) */
+static long resp_body_off(const char *data, long len) {
+    for (long i = 3; i < len; i++)
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+            return i + 1;
+    return -1;
+}
+
+/* 응답 헤더 data[0..hdrlen) 에서 name의 값을 val에 (없으면 0) */
+static int resp_header(const char *data, long hdrlen, const char *name, char *val, size_t vlen) {
+    size_t nlen = strlen(name);
+    const char *p = data, *end = data + hdrlen, *eol;
+
+    while (p < end && (eol = memchr(p, '\n', end - p)) != NULL) {
+        if (eol - p > (long) nlen && !strncasecmp(p, name, nlen) && p[nlen] == ':') {
+            const char *v = p + nlen + 1;
+            while (*v == ' ')
+                v++;
+            size_t n = eol - v - (eol[-1] == '\r');
+            if (n >= vlen)
+                n = vlen - 1;
+            memcpy(val, v, n);
+            val[n] = '\0';
+            return 1;
+        }
+        p = eol + 1;
+    }
+    return 0;
+}
+
+/* 206 응답을 새로 만들 때 원서버 헤더에서 빼는 것들 (다시 쓰거나 의미가 바뀜) */
+static int hop_or_length_header(const char *line) {
+    static const char *skip[] = { "Content-length:", "Content-type:", "Content-range:",
+                                  "Connection:", "Proxy-Connection:", "Accept-Ranges:",
+                                  "Transfer-Encoding:", NULL };
+    for (int i = 0; skip[i]; i++)
+        if (!strncasecmp(line, skip[i], strlen(skip[i])))
+            return 1;
+    return 0;
+}
+
+/* 구간 본문 출처: 메모리 (base 오프셋부터의 바이트) */
+typedef struct {
+    const char *data;
+    long base;
+} mem_src_t;
+
+static int mem_src(void *ctx, int fd, long off, long len) {
+    mem_src_t *m = ctx;
+    return rio_writen(fd, (void *) (m->data + off - m->base), len) < 0 ? -1 : 0;
+}
+
+/* 구간 본문 출처: 캐시의 블록들 */
+typedef struct {
+    long idx[SEG_BLOCKS];
+    CacheNode *node[SEG_BLOCKS];
+    int n;
+} seg_src_t;
+
+static int seg_src(void *ctx, int fd, long off, long len) {
+    seg_src_t *s = ctx;
+
+    while (len > 0) {
+        long i = off / SEG_SIZE, in = off % SEG_SIZE, chunk;
+        int k = 0;
+        while (k < s->n && s->idx[k] != i)
+            k++;
+        if (k == s->n)
+            return -1;              /* 모아 둔 블록 밖 - 생기면 안 됨 */
+        chunk = s->node[k]->size - in;
+        if (chunk > len)
+            chunk = len;
+        if (rio_writen(fd, s->node[k]->data + in, chunk) < 0)
+            return -1;
+        off += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * spec을 크기 size인 본문에 적용해 206 (또는 416) 을 보낸다.
+ * ohdrs[0..ohdrlen)는 같이 보낼 원서버 헤더 (상태 줄 포함, NULL 가능).
+ * 리턴: 보낸 바이트, -1: 쓰기 실패, -2: Range를 무시해야 함 (전체를 보낼 것)
+ */
+static long send_ranges(int fd, const char *spec, const char *ohdrs, long ohdrlen,
+                        const char *ctype, long size, range_src_t src, void *ctx,
+                        access_t *acc) {
+    range_t r[RANGE_MAX];
+    int nr = range_parse(spec, size, r, RANGE_MAX);
+    buf_t *hdr;
+    long rc;
+
+    if (nr == 0)
+        return -2;
+    hdr = buf_get();
+    if (nr < 0) {
+        buf_reserve(hdr, MAXLINE);
+        hdr->len = range_416(hdr->data, MAXLINE, size);
+        acc->status = 416;
+    } else {
+        buf_printf(hdr, "HTTP/1.0 206 Partial Content\r\n");
+        /* 원서버 헤더 중 길이/형식/연결과 무관한 것은 그대로 (상태 줄은 건너뜀) */
+        const char *p = ohdrs ? memchr(ohdrs, '\n', ohdrlen) : NULL, *eol;
+        while (p && ++p < ohdrs + ohdrlen && (eol = memchr(p, '\n', ohdrs + ohdrlen - p)) != NULL) {
+            if (eol - p > 1 && !hop_or_length_header(p))
+                buf_append(hdr, p, eol - p + 1);
+            p = eol;
+        }
+        buf_printf(hdr, "Accept-Ranges: bytes\r\n");
+        buf_reserve(hdr, MAXLINE);
+        hdr->len += range_headers(hdr->data + hdr->len, MAXLINE, ctype, r, nr, size);
+        buf_printf(hdr, "Connection: close\r\n\r\n");
+        acc->status = 206;
+    }
+    rc = rio_writen(fd, hdr->data, hdr->len) < 0 ? -1 : (long) hdr->len;
+    buf_put(hdr);
+    if (rc > 0 && nr > 0) {
+        long body = range_send_body(fd, ctype, r, nr, size, src, ctx);
+        rc = body < 0 ? -1 : rc + body;
+    }
+    return rc;
+}
+
+/* 전체 크기 total인 객체의 [first, last] 를 담은 바이트들 중 완전한 블록을 캐시에 */
+static void seg_store(const char *uri, const char *body, long first, long last,
+                      long total, const char *ctype) {
+    char key[MAXLINE + 32], meta[MAXLINE];
+    CacheNode *node;
+    int n;
+
+    snprintf(key, sizeof(key), "%s meta", uri);
+    if ((node = cache_get(key)) != NULL)
+        cache_release(node);
+    else {
+        n = snprintf(meta, sizeof(meta), "%ld %s", total, ctype);
+        cache_store(key, meta, n);
+    }
+    for (long i = (first + SEG_SIZE - 1) / SEG_SIZE; ; i++) {
+        long bfirst = i * SEG_SIZE, blast = bfirst + SEG_SIZE - 1;
+        if (blast > total - 1)
+            blast = total - 1;
+        if (bfirst > last || blast > last)
+            break;
+        snprintf(key, sizeof(key), "%s seg=%ld", uri, i);
+        if ((node = cache_get(key)) != NULL) {
+            cache_release(node);
+            continue;
+        }
+        cache_store(key, (char *) body + (bfirst - first), blast - bfirst + 1);
+    }
+}
+
+/*
+ * 캐시에서 Range 요청에 답해 본다 (전체 객체 또는 블록들).
+ * 리턴: 보낸 바이트 (>0), 0: 캐시로는 못 함 (원서버로), -1: 쓰기 실패
+ */
+static long range_from_cache(int fd, char *uri, const char *spec, access_t *acc) {
+    char key[MAXLINE + 32], ctype[MAXLINE] = "application/octet-stream";
+    CacheNode *node;
+    seg_src_t seg = { .n = 0 };
+    range_t r[RANGE_MAX];
+    long rc = 0, total, off;
+    int nr;
+
+    /* 1. 전체 객체 */
+    if ((node = cache_get(uri)) != NULL) {
+        off = resp_body_off(node->data, node->size);
+        if (resp_status(node->data, node->size) == 200 && off >= 0) {
+            mem_src_t m = { node->data + off, 0 };
+            resp_header(node->data, off, "Content-type", ctype, sizeof(ctype));
+            rc = send_ranges(fd, spec, node->data, off, ctype, node->size - off, mem_src, &m, acc);
+        } else {
+            rc = -2;
+        }
+        if (rc == -2)
+            rc = rio_writen(fd, node->data, node->size) < 0 ? -1 : node->size;
+        cache_release(node);
+        stats_inc(STAT_CACHE_HIT);
+        return rc;
+    }
 
-        /* 핵심 로직 수행 */
-        doit(connfd);
+    /* 2. 블록들: 크기를 알아야 구간을 정할 수 있다 */
+    snprintf(key, sizeof(key), "%s meta", uri);
+    if ((node = cache_get(key)) == NULL)
+        goto miss;
+    snprintf(key, sizeof(key), "%.*s", node->size, node->data);     /* "크기 형식" */
+    cache_release(node);
+    if (sscanf(key, "%ld %[^\n]", &total, ctype) < 1)
+        goto miss;
+
+    if ((nr = range_parse(spec, total, r, RANGE_MAX)) > 0) {
+        for (int k = 0; k < nr; k++)
+            for (long i = r[k].first / SEG_SIZE; i <= r[k].last / SEG_SIZE; i++) {
+                int j = 0;
+                while (j < seg.n && seg.idx[j] != i)
+                    j++;
+                if (j < seg.n)
+                    continue;
+                snprintf(key, sizeof(key), "%s seg=%ld", uri, i);
+                if (seg.n == SEG_BLOCKS || (node = cache_get(key)) == NULL)
+                    goto release;
+                seg.idx[seg.n] = i;
+                seg.node[seg.n++] = node;
+            }
+    } else if (nr == 0) {
+        goto miss;                  /* Range를 무시할 요청 - 원서버가 전체를 */
+    }
+    rc = send_ranges(fd, spec, NULL, 0, ctype, total, seg_src, &seg, acc);
+    stats_inc(STAT_CACHE_HIT);
+release:
+    for (int j = 0; j < seg.n; j++)
+        cache_release(seg.node[j]);
+    if (rc != 0)
+        return rc;
+miss:
+    stats_inc(STAT_CACHE_MISS);
+    return 0;
+}
 
-        /* 연결 종료 */
-        Close(connfd);
+/*
+ * 원서버의 응답 전체 (obj) 로 Range 요청에 답하고, 캐시할 수 있는 것은 넣는다.
+ * want: 클라이언트가 요청한 구간 spec
+ */
+static long range_from_origin(int fd, char *uri, const char *spec, buf_t *obj, access_t *acc) {
+    char ctype[MAXLINE] = "application/octet-stream", cr[MAXLINE];
+    long off = resp_body_off(obj->data, obj->len), first, last, total, rc = -2;
+    int status = resp_status(obj->data, obj->len);
+
+    if (off < 0)
+        goto verbatim;
+    resp_header(obj->data, off, "Content-type", ctype, sizeof(ctype));
+    if (status == 200) {
+        /* 원서버가 Range를 무시하고 전체를 줌: 전체로 캐시하고 구간만 돌려준다 */
+        mem_src_t m = { obj->data + off, 0 };
+        if (obj->len <= MAX_OBJECT_SIZE)
+            cache_store(uri, obj->data, obj->len);
+        rc = send_ranges(fd, spec, obj->data, off, ctype, obj->len - off, mem_src, &m, acc);
+    } else if (status == 206 && resp_header(obj->data, off, "Content-range", cr, sizeof(cr)) &&
+               sscanf(cr, "bytes %ld-%ld/%ld", &first, &last, &total) == 3 &&
+               last - first + 1 == obj->len - off) {
+        /* 한 구간짜리 206: 블록째 캐시에 넣고, 요청한 구간이 그 안이면 잘라서 */
+        mem_src_t m = { obj->data + off, first };
+        range_t r[RANGE_MAX];
+        int nr = range_parse(spec, total, r, RANGE_MAX);
+
+        seg_store(uri, obj->data + off, first, last, total, ctype);
+        int inside = nr > 0;
+        for (int k = 0; k < nr; k++)
+            inside &= r[k].first >= first && r[k].last <= last;
+        /* [수정] 넓혀서 받은 구간은 만족돼도 원래 구간이 아니면 416 (send_ranges가) */
+        if (inside || nr < 0)
+            rc = send_ranges(fd, spec, obj->data, off, ctype, total, mem_src, &m, acc);
     }
+    if (rc != -2)
+        return rc;
+verbatim:
+    acc->status = status;
+    return rio_writen(fd, obj->data, obj->len) < 0 ? -1 : (long) obj->len;
 }
 
 /*
  * doit - 단일 HTTP 트랜잭션을 처리합니다.
+ *
+ * [수정] 대문자 csapp 래퍼(Rio_*, Open_clientfd)는 실패 시 exit()하므로
+ * 한 클라이언트의 연결 끊김(EPIPE/ECONNRESET)이 프록시 전체를 죽였다.
+ * 이제 소문자 rio_* / open_clientfd를 사용하고, 실패는 카운트한 뒤
+ * 이 연결만 정리하고 리턴한다.
  */
-void doit(int fd) {
+void doit(int fd, access_t *acc) {
     int serverfd;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-    char host[MAXLINE], port[MAXLINE], path[MAXLINE];
-    char request_buf[MAXLINE]; // 서버로 보낼 요청을 저장할 버퍼
-
-    /* [수정] request_buf의 끝을 가리킬 포인터 선언 */
-    char *p = request_buf;
+    /*
+     * [수정] 고정 크기 MAXLINE 배열 열 개 가까이를 스택에 두던 것을 줄였다.
+     * 서버로 보낼 요청과 응답 캡처/중계는 스레드 풀의 늘어나는 버퍼를
+     * 쓰고, path는 uri 안을 가리킨다 (uri는 그대로 캐시 키가 된다).
+     */
+    char buf[MAXLINE], version[16], range[MAXLINE];
+    char *method = acc->method, *uri = acc->uri; /* 접근 로그에도 쓰임 */
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    const char *path, *v;
+    ssize_t rc, hdr_len = 0;
 
     rio_t client_rio, server_rio;
     int Does_send_host_header = 0; // Host 헤더 전송 여부 플래그
+    int widened = 0;               // 구간을 블록 경계로 넓혀서 요청했는지
+    long t0, t1;
 
     /* 1. 클라이언트로부터 요청 라인과 헤더 읽기 */
-    Rio_readinitb(&client_rio, fd);
-    if (Rio_readlineb(&client_rio, buf, MAXLINE) == 0) {
+    rio_readinitb(&client_rio, fd);
+    if ((rc = rio_readlineb(&client_rio, buf, MAXLINE)) <= 0) {
+        if (rc < 0)
+            stats_inc(STAT_CLIENT_READ_ERR);
         return; // 빈 요청은 무시
     }
-
-    sscanf(buf, "%s %s %s", method, uri, version);
+    t0 = stats_now_ns(); /* [수정] 구간별 시간은 요청 라인이 도착한 뒤부터 */
+
+    if (sscanf(buf, "%15s %s %15s", method, uri, version) != 3) {
+        stats_inc(STAT_BAD_REQUEST);
+        strcpy(method, "-");
+        strcpy(uri, "-");
+        acc->status = 400;
+        clienterror(fd, buf, "400", "Bad Request",
+                    "Proxy could not parse the request line");
+        return;
+    }
 
     if (strcasecmp(method, "GET")) {
+        acc->status = 501;
         clienterror(fd, method, "501", "Not Implemented",
                     "Proxy does not implement this method");
         return;
     }
-
-    char cache_key[MAXLINE];
-    strcpy(cache_key, uri);
+    trace_ev(fd, TR_PARSED);
 
     /*
-     * [캐싱] 2. 캐시에서 객체 찾기
+     * 2. URI 해석 (캐시 키는 uri 그대로)
+     * [수정] Range가 있는지 알아야 캐시에서 어떻게 답할지 정할 수 있으므로
+     * 요청 헤더를 캐시 조회보다 먼저 다 읽는다
      */
-    if (cache_find(cache_key, fd)) {
-        printf("Cache hit for %s\n", cache_key);
+    if (parse_uri(uri, host, port, &path) < 0) {
+        stats_inc(STAT_BAD_REQUEST);
+        acc->status = 400;
+        clienterror(fd, uri, "400", "Bad Request",
+                    "Proxy only handles absolute http:// URIs");
         return;
     }
-    printf("Cache miss for %s\n", cache_key);
 
+    /* [수정] 2a. 요청은 풀의 버퍼에 조립 (헤더가 들어오는 만큼만 커짐) */
+    buf_t *req = buf_get();
+    buf_printf(req, "GET %s HTTP/1.0\r\n", path);
 
-    /*
-     * 3. 캐시 미스(Miss): 서버에 요청 (1부 로직)
-     */
-    parse_uri(uri, host, port, path);
-
-    /* [수정] 3a. 포인터(p)를 이용해 request_buf에 쓰기 */
-    p += sprintf(p, "GET %s HTTP/1.0\r\n", path);
-
-    /* [수정] 3b. 포인터를 이동시키며 헤더 이어 붙이기 */
-    while (Rio_readlineb(&client_rio, buf, MAXLINE) > 0) {
+    /* [수정] 2b. 헤더 이어 붙이기 (Range는 따로 두었다가 아래에서 정해서 붙임) */
+    range[0] = '\0';
+    while ((rc = rio_readlineb(&client_rio, buf, MAXLINE)) > 0) {
         if (strcmp(buf, "\r\n") == 0)
             break;
+        /* [수정] 버퍼가 늘어나므로 헤더 총량은 여기서 막는다 */
+        if ((hdr_len += rc) > MAX_HEADER_SIZE)
+            break;
 
         if (strstr(buf, "User-Agent:"))
             continue;
@@ -144,97 +608,226 @@ void doit(int fd) {
             continue;
         if (strstr(buf, "Proxy-Connection:"))
             continue;
+        /* [수정] 캐시는 URI 하나에 한 가지 본문 - 압축본이 섞이지 않게 원본만 받는다 */
+        if (strstr(buf, "Accept-Encoding:"))
+            continue;
+        /* [수정] 조건부 요청도 빼고 전체를 받는다 (304를 캐시에 넣지 않도록) */
+        if (strstr(buf, "If-None-Match:") || strstr(buf, "If-Modified-Since:"))
+            continue;
+        if ((v = range_find(buf)) != NULL) {
+            snprintf(range, sizeof(range), "%.*s", (int) strcspn(v, "\r\n"), v);
+            continue;
+        }
 
         if (strstr(buf, "Host:")) {
             Does_send_host_header = 1;
         }
-        /* p가 가리키는 곳(버퍼의 끝)에 안전하게 이어 씀 */
-        p += sprintf(p, "%s", buf);
+        buf_append(req, buf, rc);
+    }
+    if (rc < 0) {
+        stats_inc(STAT_CLIENT_READ_ERR);
+        buf_put(req);
+        return;
+    }
+    if (hdr_len > MAX_HEADER_SIZE) {
+        stats_inc(STAT_BAD_REQUEST);
+        acc->status = 431;
+        clienterror(fd, "request headers", "431", "Request Header Fields Too Large",
+                    "Proxy limits the request headers to 64KB");
+        /* 남은 헤더를 비운다 (안 읽은 채 닫으면 RST가 431을 지운다) */
+        shutdown(fd, SHUT_WR);
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+        buf_put(req);
+        return;
+    }
+    /* 파싱 시간: 요청 라인 파싱 + 헤더 읽기 */
+    stats_observe(HIST_PARSE, stats_now_ns() - t0);
+
+    /*
+     * [캐싱] 3. 캐시에서 객체 찾기 (Range 요청이면 구간만)
+     */
+    t1 = stats_now_ns();
+    rc = range[0] ? range_from_cache(fd, uri, range, acc) : cache_find(uri, fd);
+    stats_observe(HIST_CACHE_FIND, stats_now_ns() - t1);
+    trace_ev(fd, rc != 0 ? TR_CACHE_HIT : TR_CACHE_MISS);
+    if (rc != 0) {
+        if (rc < 0)
+            stats_inc(STAT_CLIENT_WRITE_ERR);
+        else
+            acc->bytes = rc;
+        acc->cache = "hit";
+        buf_put(req);
+        return;
     }
+    acc->cache = "miss";
 
-    /* [수정] 3c. 포인터를 이용해 필수 헤더 이어 붙이기 */
+    /*
+     * 4. 캐시 미스(Miss): 서버에 요청 (1부 로직)
+     */
+    /* [수정] 4a. 필수 헤더 이어 붙이기 */
     if (!Does_send_host_header) {
-        p += sprintf(p, "Host: %s\r\n", host);
+        buf_printf(req, "Host: %s\r\n", host);
+    }
+    /*
+     * [수정] 구간 미스: 끝이 정해진 구간 하나면 블록 경계로 넓혀서 받아 온다
+     * (받은 블록을 캐시에 넣어 다음 탐색(seek)이 히트하도록)
+     */
+    if (range[0]) {
+        range_t r;
+        if (range_parse(range, LONG_MAX, &r, 1) == 1 && r.last < LONG_MAX - 1 &&
+            r.last / SEG_SIZE - r.first / SEG_SIZE < SEG_FETCH_MAX) {
+            buf_printf(req, "Range: bytes=%ld-%ld\r\n", r.first / SEG_SIZE * SEG_SIZE,
+                       (r.last / SEG_SIZE + 1) * SEG_SIZE - 1);
+            widened = 1;
+        } else
+            buf_printf(req, "Range: %s\r\n", range);
     }
     /* user_agent_hdr은 \r\n을 이미 포함하고 있습니다. */
-    p += sprintf(p, "%s", user_agent_hdr);
-    p += sprintf(p, "Connection: close\r\n");
-    p += sprintf(p, "Proxy-Connection: close\r\n");
-    p += sprintf(p, "\r\n"); // 헤더 끝
-
-    /* 4. 실제 웹 서버에 연결 및 요청 전송 */
-    serverfd = Open_clientfd(host, port);
+    buf_printf(req, "%sConnection: close\r\nProxy-Connection: close\r\n\r\n",
+               user_agent_hdr);
+
+    /* 4b. 실제 웹 서버에 연결 및 요청 전송 */
+    /* (코루틴 안이면 connect를 기다리는 동안 양보한다) */
+    t1 = stats_now_ns();
+    serverfd = co_open_clientfd(host, port);
+    stats_observe(HIST_CONNECT, stats_now_ns() - t1);
+    trace_ev(fd, TR_CONNECTED);
+    if (serverfd < 0) {
+        stats_inc(STAT_ORIGIN_CONNECT_ERR);
+        acc->status = 502;
+        clienterror(fd, host, "502", "Bad Gateway",
+                    "Proxy could not connect to the origin server");
+        buf_put(req);
+        return;
+    }
 
-    /* [수정] strlen 대신 포인터 연산으로 정확한 크기 전송 (더 안전함) */
-    Rio_writen(serverfd, request_buf, (p - request_buf));
+    t1 = stats_now_ns();
+    rc = rio_writen(serverfd, req->data, req->len);
+    buf_put(req);
+    if (rc < 0) {
+        stats_inc(STAT_ORIGIN_WRITE_ERR);
+        Close(serverfd);
+        return;
+    }
 
     /*
-     * 5. 서버 응답 중계 및 캐시 저장 (이 부분은 문제가 없었음)
+     * 5. 서버 응답 중계 및 캐시 저장
+     *
+     * [수정] 응답은 캡처 버퍼의 끝에 바로 읽어 들여 그 자리에서 클라이언트로
+     * 보낸다 (중계용 복사 없음). 버퍼는 받은 만큼만 커지고, 객체가
+     * MAX_OBJECT_SIZE를 넘으면 캡처를 포기하고 앞부분을 중계용으로만 쓴다.
+     * [수정] Range 요청은 응답을 RANGE_BUF_MAX까지 다 모은 뒤
+     * range_from_origin이 구간을 골라 보내고 캐시에 넣는다 (넘치면 중계로).
      */
-    Rio_readinitb(&server_rio, serverfd);
-    size_t n;
-
-    char *cache_buf = Malloc(MAX_OBJECT_SIZE);
-    int total_bytes_read = 0;
-    int can_cache = 1;
-
-    while ((n = Rio_readnb(&server_rio, buf, MAXLINE)) > 0) {
-        Rio_writen(fd, buf, n);
-        if (can_cache) {
-            if (total_bytes_read + n <= MAX_OBJECT_SIZE) {
-                memcpy(cache_buf + total_bytes_read, buf, n);
-                total_bytes_read += n;
-            } else {
-                can_cache = 0;
-            }
+    rio_readinitb(&server_rio, serverfd);
+    buf_t *obj = buf_get();
+    int can_cache = 1, buffering = range[0] != '\0';
+    long got = 0;
+    ssize_t n;
+
+    while ((n = rio_readnb(&server_rio, buf_reserve(obj, MAXLINE), MAXLINE)) > 0) {
+        if (got == 0) {
+            stats_observe(HIST_TTFB, stats_now_ns() - t1);
+            trace_ev(fd, TR_FIRST_BYTE);
+            acc->status = resp_status(obj->data + obj->len, n);
+        }
+        got += n;
+        if (buffering) {
+            obj->len += n;
+            if (obj->len <= RANGE_BUF_MAX)
+                continue;
+            /* 너무 큼: 모은 것을 보내고 나머지는 그냥 중계 (캐시 안 함) */
+            buffering = can_cache = 0;
+            n = obj->len;
+            obj->len = 0;
+        }
+        if (rio_writen(fd, obj->data + obj->len, n) < 0) {
+            /* 클라이언트가 중간에 끊음: 불완전한 객체는 캐시하지 않음 */
+            stats_inc(STAT_CLIENT_WRITE_ERR);
+            can_cache = 0;
+            break;
         }
+        acc->bytes += n;
+        if (can_cache && obj->len + n <= MAX_OBJECT_SIZE) {
+            obj->len += n;
+        } else {
+            can_cache = 0;
+            obj->len = 0;
+        }
+    }
+    if (n < 0) {
+        stats_inc(STAT_ORIGIN_READ_ERR);
+        can_cache = 0;
     }
     Close(serverfd);
 
-    if (can_cache && total_bytes_read > 0) {
-        cache_store(cache_key, cache_buf, total_bytes_read);
+    if (buffering && n < 0 && widened) {
+        /* [수정] 넓혀서 받다가 실패: 받은 것은 클라이언트가 청한 구간이 아님 */
+        acc->status = 502;
+        clienterror(fd, host, "502", "Bad Gateway",
+                    "Proxy could not read the range from the origin server");
+    } else if (buffering) {
+        /* 모은 Range 응답 (읽다 실패했으면 받은 만큼 그대로) */
+        rc = n < 0 ? (rio_writen(fd, obj->data, obj->len) < 0 ? -1 : (ssize_t) obj->len)
+                   : range_from_origin(fd, uri, range, obj, acc);
+        if (rc < 0)
+            stats_inc(STAT_CLIENT_WRITE_ERR);
+        else
+            acc->bytes += rc;
+    } else if (can_cache && obj->len > 0 && !range[0]) {
+        cache_store(uri, obj->data, obj->len);
     }
-    Free(cache_buf);
+    buf_put(obj);
 }
 
 /*
  * parse_uri - HTTP 프록시 URI를 파싱합니다.
  * (예: "http://www.cmu.edu:8080/hub/index.html")
+ * 성공 시 0, "http://" 형식이 아니면 -1 리턴
  */
-void parse_uri(char *uri, char *host, char *port, char *path) {
-    char *ptr;
+int parse_uri(char *uri, char *host, char *port, const char **path) {
+    char *ptr, *end, *colon;
+    size_t len;
 
     /* "http://" 부분 건너뛰기 */
     if (!(ptr = strstr(uri, "http://"))) {
-        // 이 실습에서는 "http://"가 항상 있다고 가정합니다.
-        return;
+        // 이 실습에서는 "http://"만 처리합니다.
+        return -1;
     }
     ptr += 7; // "http://" 다음부터 시작 (예: "www.cmu.edu:8080/...")
 
-    /* 경로(path) 찾기 */
-    char *path_ptr = strchr(ptr, '/');
-    if (path_ptr) {
-        strcpy(path, path_ptr); // (예: "/hub/index.html")
-        *path_ptr = '\0'; // 호스트/포트 부분과 경로 분리
+    /* [수정] 경로(path)는 복사하지 않고 uri 안을 가리킴 (uri는 수정하지 않음) */
+    if ((end = strchr(ptr, '/'))) {
+        *path = end; // (예: "/hub/index.html")
     } else {
-        strcpy(path, "/"); // 경로가 없으면 기본값 "/"
+        *path = "/"; // 경로가 없으면 기본값 "/"
+        end = ptr + strlen(ptr);
     }
 
     /* 포트(port) 찾기 */
-    char *port_ptr = strchr(ptr, ':');
-    if (port_ptr) {
-        *port_ptr = '\0'; // 호스트와 포트 분리
-        strcpy(port, port_ptr + 1); // (예: "8080")
+    if ((colon = memchr(ptr, ':', end - ptr))) {
+        len = end - colon - 1;
+        if (len == 0 || len >= NI_MAXSERV)
+            return -1;
+        memcpy(port, colon + 1, len); // (예: "8080")
+        port[len] = '\0';
     } else {
         strcpy(port, "80"); // 포트가 없으면 기본값 "80"
     }
 
     /* 남은 부분이 호스트(host) */
-    strcpy(host, ptr); // (예: "www.cmu.edu")
+    len = (colon ? colon : end) - ptr;
+    if (len == 0 || len >= NI_MAXHOST)
+        return -1;
+    memcpy(host, ptr, len); // (예: "www.cmu.edu")
+    host[len] = '\0';
+    return 0;
 }
 
 /*
  * clienterror - tiny.c에서 가져온 오류 메시지 전송 함수
+ * (쓰기 실패는 카운트만 하고 무시: 어차피 연결은 곧 닫힌다)
  */
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg) {
     char buf[MAXLINE], body[MAXBUF];
@@ -247,11 +840,9 @@ void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longms
     sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
 
     /* Print the HTTP response */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n\r\n", (int) strlen(body));
-    Rio_writen(fd, buf, strlen(buf));
-    Rio_writen(fd, body, strlen(body));
+    sprintf(buf, "HTTP/1.0 %s %s\r\n"
+                 "Content-type: text/html\r\n"
+                 "Content-length: %d\r\n\r\n", errnum, shortmsg, (int) strlen(body));
+    if (rio_writen(fd, buf, strlen(buf)) < 0 || rio_writen(fd, body, strlen(body)) < 0)
+        stats_inc(STAT_CLIENT_WRITE_ERR);
 }
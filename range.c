@@ -0,0 +1,142 @@
+/*
+ * range.c - HTTP 바이트 구간 요청 처리 (range.h 참고)
+ */
+#include "range.h"
+
+/* 공백 건너뛰기 */
+static const char *skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+int range_parse(const char *spec, long size, range_t *r, int max)
+{
+    const char *p = skip_ws(spec);
+    int n = 0, nspec = 0;
+
+    if (strncasecmp(p, "bytes", 5))
+        return 0;
+    p = skip_ws(p + 5);
+    if (*p++ != '=')
+        return 0;
+
+    while (1) {
+        long first, last;
+        char *end;
+
+        p = skip_ws(p);
+        if (*p == '-') {                        /* "-N": 끝에서 N바이트 */
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < 0)
+                return 0;
+            first = last == 0 ? size :          /* "-0"은 만족 불가 */
+                    last < size ? size - last : 0;
+            last = size - 1;
+        } else {
+            first = strtol(p, &end, 10);
+            if (end == p || first < 0 || *end != '-')
+                return 0;
+            p = end + 1;
+            if (*p >= '0' && *p <= '9') {
+                last = strtol(p, &end, 10);
+                if (last < first)
+                    return 0;
+            } else {
+                last = size - 1;
+                end = (char *) p;
+            }
+            if (last > size - 1)
+                last = size - 1;
+        }
+        if (++nspec > max)
+            return 0;                           /* 구간 폭탄 - 전체를 보낸다 */
+        if (first < size && first <= last) {
+            r[n].first = first;
+            r[n].last = last;
+            n++;
+        }
+        p = skip_ws(end);
+        if (*p == '\0' || *p == '\r' || *p == '\n')
+            break;
+        if (*p++ != ',')
+            return 0;
+    }
+    return n > 0 ? n : -1;
+}
+
+const char *range_find(const char *hdrs)
+{
+    const char *p = hdrs;
+
+    while (p && *p) {
+        if (!strncasecmp(p, "Range:", 6))
+            return skip_ws(p + 6);
+        if ((p = strchr(p, '\n')) != NULL)
+            p++;
+    }
+    return NULL;
+}
+
+/* multipart의 한 조각 앞에 붙는 경계와 헤더 */
+static int part_header(char *buf, size_t len, const char *ctype, const range_t *r, long size)
+{
+    return snprintf(buf, len, "\r\n--" RANGE_BOUNDARY "\r\n"
+                    "Content-type: %s\r\n"
+                    "Content-range: bytes %ld-%ld/%ld\r\n\r\n",
+                    ctype, r->first, r->last, size);
+}
+
+#define RANGE_TRAILER "\r\n--" RANGE_BOUNDARY "--\r\n"
+
+int range_headers(char *buf, size_t len, const char *ctype,
+                  const range_t *r, int nr, long size)
+{
+    char part[MAXLINE];
+    long total = 0;
+
+    if (nr == 1)
+        return snprintf(buf, len, "Content-range: bytes %ld-%ld/%ld\r\n"
+                        "Content-type: %s\r\n"
+                        "Content-length: %ld\r\n",
+                        r->first, r->last, size, ctype, r->last - r->first + 1);
+    for (int i = 0; i < nr; i++)
+        total += part_header(part, sizeof(part), ctype, &r[i], size) +
+                 r[i].last - r[i].first + 1;
+    total += strlen(RANGE_TRAILER);
+    return snprintf(buf, len, "Content-type: multipart/byteranges; boundary=" RANGE_BOUNDARY "\r\n"
+                    "Content-length: %ld\r\n", total);
+}
+
+int range_416(char *buf, size_t len, long size)
+{
+    return snprintf(buf, len, "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                    "Content-range: bytes */%ld\r\n"
+                    "Content-length: 0\r\n"
+                    "Connection: close\r\n\r\n", size);
+}
+
+long range_send_body(int fd, const char *ctype, const range_t *r, int nr,
+                     long size, range_src_t src, void *ctx)
+{
+    char part[MAXLINE];
+    long sent = 0;
+    int n;
+
+    if (nr == 1) {
+        if (src(ctx, fd, r->first, r->last - r->first + 1) < 0)
+            return -1;
+        return r->last - r->first + 1;
+    }
+    for (int i = 0; i < nr; i++) {
+        n = part_header(part, sizeof(part), ctype, &r[i], size);
+        if (rio_writen(fd, part, n) < 0 ||
+            src(ctx, fd, r[i].first, r[i].last - r[i].first + 1) < 0)
+            return -1;
+        sent += n + r[i].last - r[i].first + 1;
+    }
+    if (rio_writen(fd, RANGE_TRAILER, strlen(RANGE_TRAILER)) < 0)
+        return -1;
+    return sent + strlen(RANGE_TRAILER);
+}
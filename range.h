@@ -0,0 +1,50 @@
+#ifndef __RANGE_H__
+#define __RANGE_H__
+
+#include "csapp.h"
+
+/*
+ * HTTP 바이트 구간 (Range: bytes=...) 처리 - 프록시와 tiny가 함께 쓴다.
+ * 구간 해석, 206 응답의 Content-* 헤더, multipart/byteranges 본문.
+ */
+#define RANGE_MAX      16               /* 이보다 많은 구간 요청은 무시 (전체 응답) */
+#define RANGE_BOUNDARY "3d6b6a416f9b5RNG"
+
+typedef struct {
+    long first, last;                   /* 포함 구간 [first, last] */
+} range_t;
+
+/*
+ * spec("bytes=0-99,200-" 등)을 크기 size인 본문에 맞춰 해석.
+ * 리턴: 만족하는 구간 수 (>0), 0: 형식 오류나 구간이 너무 많음 (Range를
+ * 무시하고 전체를 보낼 것), -1: 만족하는 구간이 없음 (416)
+ */
+int range_parse(const char *spec, long size, range_t *r, int max);
+
+/*
+ * 헤더 묶음 hdrs ("이름: 값\r\n" 줄들)에서 Range 값의 시작 (없으면 NULL).
+ * 값은 줄 끝 (\r 또는 \n) 까지
+ */
+const char *range_find(const char *hdrs);
+
+/*
+ * 206 응답에 들어갈 Content-range/Content-type/Content-length 줄들을 buf에.
+ * 여러 구간이면 Content-type은 multipart/byteranges. 리턴: 쓴 길이
+ */
+int range_headers(char *buf, size_t len, const char *ctype,
+                  const range_t *r, int nr, long size);
+
+/* 416 응답 전체 (상태 줄부터 빈 줄까지). 리턴: 쓴 길이 */
+int range_416(char *buf, size_t len, long size);
+
+/* 본문 [off, off+len)을 fd로 보내는 함수 (메모리 또는 sendfile 등). 실패 -1 */
+typedef int (*range_src_t)(void *ctx, int fd, long off, long len);
+
+/*
+ * 206 본문을 보냄 (한 구간이면 그 바이트만, 여러 구간이면 multipart).
+ * 리턴: 보낸 바이트 또는 -1 (쓰기 실패)
+ */
+long range_send_body(int fd, const char *ctype, const range_t *r, int nr,
+                     long size, range_src_t src, void *ctx);
+
+#endif /* __RANGE_H__ */
@@ -1,14 +1,28 @@
 #include "sbuf.h"
+#include "futex.h"
+#include "stats.h"
+
+/* 잠들기 전에 재시도할 횟수 (CPU가 하나뿐이면 스핀해도 상대가 못 돌므로 0) */
+#define SBUF_SPIN 128
+static int sbuf_spin = -1;
 
 /* 공유 버퍼 초기화 */
 void sbuf_init(sbuf_t *sp, int n)
 {
-    sp->buf = Calloc(n, sizeof(int)); 
-    sp->n = n;                       /* 버퍼 크기 */
+    size_t cap = 2;                  /* 1칸이면 seq로 빈 칸과 찬 칸을 구분할 수 없음 */
+
+    while (cap < n)                  /* 인덱스 계산을 마스크로 하기 위해 */
+        cap <<= 1;                   /* 2의 거듭제곱으로 올림 */
+    sp->buf = Calloc(cap, sizeof(sbuf_slot_t));
+    for (size_t i = 0; i < cap; i++)
+        sp->buf[i].seq = i;          /* i번 칸은 i번째 삽입을 기다림 */
+    sp->n = cap;                     /* 버퍼 크기 */
+    sp->mask = cap - 1;
     sp->front = sp->rear = 0;        /* 큐는 비어있음 */
-    Sem_init(&sp->mutex, 0, 1);      /* 뮤텍스 (초기값 1) */
-    Sem_init(&sp->slots, 0, n);      /* 비어있는 슬롯 (초기값 n) */
-    Sem_init(&sp->items, 0, 0);      /* 사용 가능한 아이템 (초기값 0) */
+    sp->items_ev = sp->slots_ev = 0;
+    sp->items_waiters = sp->slots_waiters = 0;
+    if (sbuf_spin < 0)
+        sbuf_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SBUF_SPIN : 0;
 }
 
 /* 버퍼 정리 */
@@ -17,24 +31,175 @@ void sbuf_deinit(sbuf_t *sp)
     Free(sp->buf);
 }
 
-/* 버퍼에 아이템(connfd) 삽입 */
+/* 버퍼에 아이템 삽입 시도 (가득 차 있으면 0) */
+int sbuf_try_insert(sbuf_t *sp, int item)
+{
+    size_t pos = __atomic_load_n(&sp->rear, __ATOMIC_RELAXED);
+    sbuf_slot_t *slot;
+
+    while (1) {
+        slot = &sp->buf[pos & sp->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)seq - (long)pos;
+
+        if (dif == 0) {              /* 빈 칸: 위치를 차지 */
+            if (__atomic_compare_exchange_n(&sp->rear, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+            stats_inc(STAT_SBUF_CAS_RETRY);
+        } else if (dif < 0) {        /* 한 바퀴 전 아이템이 아직 안 빠짐: 가득 참 */
+            return 0;
+        } else {                     /* 다른 생산자가 먼저 차지함 */
+            stats_inc(STAT_SBUF_CAS_RETRY);
+            pos = __atomic_load_n(&sp->rear, __ATOMIC_RELAXED);
+        }
+    }
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    /* 잠든 소비자가 있을 때만 깨운다 (평소에는 시스템 콜 없음) */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sp->items_waiters, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&sp->items_ev, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&sp->items_ev, 1);
+    }
+    return 1;
+}
+
+/* 버퍼에서 아이템 꺼내기 시도 (비어 있으면 0) */
+int sbuf_try_remove(sbuf_t *sp, int *item)
+{
+    size_t pos = __atomic_load_n(&sp->front, __ATOMIC_RELAXED);
+    sbuf_slot_t *slot;
+
+    while (1) {
+        slot = &sp->buf[pos & sp->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long dif = (long)seq - (long)(pos + 1);
+
+        if (dif == 0) {              /* 채워진 칸: 위치를 차지 */
+            if (__atomic_compare_exchange_n(&sp->front, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+            stats_inc(STAT_SBUF_CAS_RETRY);
+        } else if (dif < 0) {        /* 아직 아무도 안 채움: 비어 있음 */
+            return 0;
+        } else {
+            stats_inc(STAT_SBUF_CAS_RETRY);
+            pos = __atomic_load_n(&sp->front, __ATOMIC_RELAXED);
+        }
+    }
+    *item = slot->item;
+    /* 다음 바퀴의 생산자(pos + n)가 쓸 수 있게 표시 */
+    __atomic_store_n(&slot->seq, pos + sp->mask + 1, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sp->slots_waiters, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&sp->slots_ev, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&sp->slots_ev, 1);
+    }
+    return 1;
+}
+
+/*
+ * 버퍼에 아이템(connfd) 삽입 - 가득 차 있으면 잠깐 스핀한 뒤 잠든다.
+ * 잠들기 직전에 이벤트 카운터를 읽고 한 번 더 시도하므로,
+ * 그 사이에 빈 슬롯이 생기면 futex_wait가 바로 리턴한다.
+ */
 void sbuf_insert(sbuf_t *sp, int item)
 {
-    P(&sp->slots);                          /* 비어있는 슬롯을 기다림 */
-    P(&sp->mutex);                          /* 버퍼 락 */
-    sp->buf[(++sp->rear)%(sp->n)] = item;   /* 아이템 삽입 */
-    V(&sp->mutex);                          /* 버퍼 언락 */
-    V(&sp->items);                          /* 아이템이 사용 가능함을 알림 */
+    for (int spin = 0; ; spin++) {
+        if (sbuf_try_insert(sp, item))
+            return;
+        if (spin < sbuf_spin) {
+            cpu_relax();
+            continue;
+        }
+        __atomic_fetch_add(&sp->slots_waiters, 1, __ATOMIC_SEQ_CST);
+        int ev = __atomic_load_n(&sp->slots_ev, __ATOMIC_SEQ_CST);
+        if (sbuf_try_insert(sp, item)) {
+            __atomic_fetch_sub(&sp->slots_waiters, 1, __ATOMIC_SEQ_CST);
+            return;
+        }
+        /* [수정] 생산자가 잠드는 시간 = 큐가 병목이라는 신호 */
+        long t = stats_now_ns();
+        futex_wait(&sp->slots_ev, ev, NULL);
+        __atomic_fetch_sub(&sp->slots_waiters, 1, __ATOMIC_SEQ_CST);
+        stats_inc(STAT_SBUF_FULL_SLEEP);
+        stats_observe(HIST_SBUF_FULL_WAIT, stats_now_ns() - t);
+    }
 }
 
-/* 버퍼에서 아이템(connfd) 꺼내기 */
+/* 버퍼에서 아이템(connfd) 꺼내기 (없으면 스핀 후 잠듦) */
 int sbuf_remove(sbuf_t *sp)
 {
     int item;
-    P(&sp->items);                          /* 아이템을 기다림 */
-    P(&sp->mutex);                          /* 버퍼 락 */
-    item = sp->buf[(++sp->front)%(sp->n)];  /* 아이템 꺼내기 */
-    V(&sp->mutex);                          /* 버퍼 언락 */
-    V(&sp->slots);                          /* 비어있는 슬롯이 생겼음을 알림 */
+
+    sbuf_remove_timed(sp, &item, -1);
     return item;
-}
\ No newline at end of file
+}
+
+/* 버퍼에서 아이템 꺼내기 - timeout_ms < 0이면 무한정 기다림 */
+int sbuf_remove_timed(sbuf_t *sp, int *item, int timeout_ms)
+{
+    struct timespec deadline, left;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (int spin = 0; ; spin++) {
+        if (sbuf_try_remove(sp, item))
+            return 1;
+        if (spin < sbuf_spin) {
+            cpu_relax();
+            continue;
+        }
+        if (timeout_ms >= 0) {       /* FUTEX_WAIT는 상대 시간을 받는다 */
+            clock_gettime(CLOCK_MONOTONIC, &left);
+            left.tv_sec = deadline.tv_sec - left.tv_sec;
+            left.tv_nsec = deadline.tv_nsec - left.tv_nsec;
+            if (left.tv_nsec < 0) {
+                left.tv_sec--;
+                left.tv_nsec += 1000000000L;
+            }
+            if (left.tv_sec < 0)
+                return 0;
+        }
+        __atomic_fetch_add(&sp->items_waiters, 1, __ATOMIC_SEQ_CST);
+        int ev = __atomic_load_n(&sp->items_ev, __ATOMIC_SEQ_CST);
+        if (sbuf_try_remove(sp, item)) {
+            __atomic_fetch_sub(&sp->items_waiters, 1, __ATOMIC_SEQ_CST);
+            return 1;
+        }
+        futex_wait(&sp->items_ev, ev, timeout_ms >= 0 ? &left : NULL);
+        __atomic_fetch_sub(&sp->items_waiters, 1, __ATOMIC_SEQ_CST);
+        stats_inc(STAT_SBUF_EMPTY_SLEEP);   /* 유휴 (경합 아님) */
+    }
+}
+
+/* 맨 앞 아이템 엿보기 - 소비자가 동시에 꺼내 가면 이미 지난 값일 수 있다 */
+int sbuf_peek(sbuf_t *sp, int *item)
+{
+    size_t pos = __atomic_load_n(&sp->front, __ATOMIC_RELAXED);
+    sbuf_slot_t *slot = &sp->buf[pos & sp->mask];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+        return 0;
+    *item = __atomic_load_n(&slot->item, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/* 현재 들어있는 아이템 수 (동시에 바뀌므로 근삿값) */
+int sbuf_count(sbuf_t *sp)
+{
+    long n = (long)(__atomic_load_n(&sp->rear, __ATOMIC_RELAXED) -
+                    __atomic_load_n(&sp->front, __ATOMIC_RELAXED));
+    return n < 0 ? 0 : (n > sp->n ? sp->n : n);
+}
@@ -3,15 +3,31 @@
 
 #include "csapp.h"
 
-/* 공유 버퍼 구조체 */
+/* 링 버퍼의 한 칸: 시퀀스 번호로 생산자/소비자 차례를 표시 */
 typedef struct {
-    int *buf;       /* 버퍼 배열 */
-    int n;          /* 최대 슬롯 수 */
-    int front;      /* buf[(front+1)%n]가 첫 번째 아이템 */
-    int rear;       /* buf[rear%n]가 마지막 아이템 */
-    sem_t mutex;    /* 버퍼 접근을 보호하기 위한 뮤텍스 */
-    sem_t slots;    /* 비어있는 슬롯의 수 */
-    sem_t items;    /* 사용 가능한 아이템(connfd)의 수 */
+    size_t seq;     /* pos와 같으면 쓰기 가능, pos+1이면 읽기 가능 */
+    int item;       /* connfd */
+} sbuf_slot_t;
+
+/*
+ * 공유 버퍼 구조체 - 락 프리 MPMC 링 버퍼 (Vyukov 방식)
+ * 생산자/소비자는 CAS로 위치를 차지하고, 비어있거나 가득 찼을 때만
+ * 잠깐 스핀한 뒤 futex로 잠든다.
+ */
+typedef struct {
+    sbuf_slot_t *buf;   /* 버퍼 배열 */
+    size_t mask;        /* 최대 슬롯 수 - 1 (슬롯 수는 2의 거듭제곱) */
+    int n;              /* 최대 슬롯 수 */
+
+    /* 생산자/소비자 위치는 서로 다른 캐시 라인에 둔다 (false sharing 방지) */
+    size_t rear __attribute__((aligned(64)));   /* 다음에 삽입할 위치 */
+    size_t front __attribute__((aligned(64)));  /* 다음에 꺼낼 위치 */
+
+    /* futex 대기용: 이벤트 카운터와 잠든 스레드 수 */
+    int items_ev __attribute__((aligned(64)));  /* 소비자가 잠들어 있을 때 삽입하면 증가 */
+    int items_waiters;                          /* 아이템을 기다리며 잠든 소비자 수 */
+    int slots_ev;                               /* 생산자가 잠들어 있을 때 꺼내면 증가 */
+    int slots_waiters;                          /* 빈 슬롯을 기다리며 잠든 생산자 수 */
 } sbuf_t;
 
 /* 함수 프로토타입 */
@@ -20,4 +36,17 @@ void sbuf_deinit(sbuf_t *sp);
 void sbuf_insert(sbuf_t *sp, int item);
 int sbuf_remove(sbuf_t *sp);
 
-#endif /* __SBUF_H__ */
\ No newline at end of file
+/* 잠들지 않는 버전: 성공 시 1, 가득 참/비어 있음이면 0 */
+int sbuf_try_insert(sbuf_t *sp, int item);
+int sbuf_try_remove(sbuf_t *sp, int *item);
+
+/* 최대 timeout_ms 동안 기다리는 버전: 성공 시 1, 시간 초과면 0 */
+int sbuf_remove_timed(sbuf_t *sp, int *item, int timeout_ms);
+
+/* 맨 앞 아이템을 꺼내지 않고 읽음: 있으면 1 (다른 스레드가 곧 꺼낼 수 있음) */
+int sbuf_peek(sbuf_t *sp, int *item);
+
+/* 현재 들어있는 아이템 수 (근삿값) */
+int sbuf_count(sbuf_t *sp);
+
+#endif /* __SBUF_H__ */
@@ -0,0 +1,369 @@
+/*
+ * stats.c - 카운터와 지연 히스토그램
+ *
+ * [수정] 예전에는 전역 배열 하나에 모든 스레드가 원자적 더하기를 해서
+ * 같은 캐시 라인을 두고 다퉜다. 이제 스레드마다 자기 블록에만 쓰고
+ * (락도 원자적 RMW도 없음), 값은 조회/출력할 때 모든 블록을 더해 얻는다.
+ * 끝난 스레드의 블록은 값을 유지한 채 다음 스레드가 이어 쓴다.
+ */
+#include "stats.h"
+#include "alloc.h"
+#include <limits.h>
+
+static const char *counter_names[STAT_NCOUNTERS] = {
+    [STAT_CONN_ACCEPTED]      = "conn_accepted",
+    [STAT_CONN_DONE]          = "conn_done",
+    [STAT_ACCEPT_ERR]         = "accept_err",
+    [STAT_BAD_REQUEST]        = "bad_request",
+    [STAT_CLIENT_READ_ERR]    = "client_read_err",
+    [STAT_CLIENT_WRITE_ERR]   = "client_write_err",
+    [STAT_ORIGIN_CONNECT_ERR] = "origin_connect_err",
+    [STAT_ORIGIN_WRITE_ERR]   = "origin_write_err",
+    [STAT_ORIGIN_READ_ERR]    = "origin_read_err",
+    [STAT_POOL_THREADS]       = "pool_threads",
+    [STAT_POOL_IDLE]          = "pool_idle",
+    [STAT_POOL_GROW]          = "pool_grow",
+    [STAT_POOL_SHRINK]        = "pool_shrink",
+    [STAT_POOL_STEAL]         = "pool_steal",
+    [STAT_FAST_HIT]           = "fast_hit",
+    [STAT_FAST_HANDOFF]       = "fast_handoff",
+    [STAT_FAST_TIMEOUT]       = "fast_timeout",
+    [STAT_CORO_ACTIVE]        = "coro_active",
+    [STAT_SHED_SLO]           = "shed_slo",
+    [STAT_SHED_IP]            = "shed_ip_cap",
+    [STAT_SHED_FD]            = "shed_no_fd",
+    [STAT_ACCEPT_BACKOFF]     = "accept_backoff",
+    [STAT_BUF_ALLOC]          = "buf_alloc",
+    [STAT_BUF_REUSE]          = "buf_reuse",
+    [STAT_BUF_BYTES]          = "buf_bytes",
+    [STAT_LOG_DROPPED]        = "log_dropped",
+    [STAT_CACHE_HIT]          = "cache_hit",
+    [STAT_CACHE_MISS]         = "cache_miss",
+    [STAT_CACHE_BYTES]        = "cache_bytes",
+    [STAT_CACHE_EVICT]        = "cache_evict",
+    [STAT_BYTES_SENT]         = "bytes_sent",
+    [STAT_QUEUE_DEPTH]        = "queue_depth",
+    [STAT_CACHE_RD_ACQ]       = "cache_lock_rd_acquired",
+    [STAT_CACHE_RD_CONTENDED] = "cache_lock_rd_contended",
+    [STAT_CACHE_WR_ACQ]       = "cache_lock_wr_acquired",
+    [STAT_CACHE_WR_CONTENDED] = "cache_lock_wr_contended",
+    [STAT_SBUF_CAS_RETRY]     = "sbuf_cas_retry",
+    [STAT_SBUF_FULL_SLEEP]    = "sbuf_full_sleep",
+    [STAT_SBUF_EMPTY_SLEEP]   = "sbuf_empty_sleep",
+};
+
+/* 게이지 (증감 또는 샘플링). 나머지는 단조 증가 카운터 */
+static const char counter_is_gauge[STAT_NCOUNTERS] = {
+    [STAT_POOL_THREADS] = 1,
+    [STAT_POOL_IDLE]    = 1,
+    [STAT_CORO_ACTIVE]  = 1,
+    [STAT_BUF_BYTES]    = 1,
+    [STAT_CACHE_BYTES]  = 1,
+    [STAT_QUEUE_DEPTH]  = 1,
+};
+
+static long (*samplers[STAT_NCOUNTERS])(void);
+
+/*
+ * 로그-선형 히스토그램: 2의 거듭제곱 구간마다 16개로 나눈다
+ * (상대 오차 약 6%). 2^40ns(약 18분)보다 큰 값은 마지막 칸에 넣는다.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP  40
+#define HIST_NBUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+static const char *hist_names[STAT_NHISTS] = {
+    [HIST_QUEUE_WAIT]      = "queue_wait",
+    [HIST_PARSE]           = "parse",
+    [HIST_CACHE_FIND]      = "cache_find",
+    [HIST_CONNECT]         = "origin_connect",
+    [HIST_TTFB]            = "origin_ttfb",
+    [HIST_TOTAL]           = "request_total",
+    [HIST_FAST_HIT]        = "fast_hit",
+    [HIST_ADMIT_WAIT]      = "admit_wait_est",
+    [HIST_CACHE_RD_WAIT]   = "cache_lock_rd_wait",
+    [HIST_CACHE_RD_HOLD]   = "cache_lock_rd_hold",
+    [HIST_CACHE_WR_WAIT]   = "cache_lock_wr_wait",
+    [HIST_CACHE_WR_HOLD]   = "cache_lock_wr_hold",
+    [HIST_SBUF_FULL_WAIT]  = "sbuf_full_wait",
+};
+
+/* 스레드 하나의 통계 (이 스레드만 쓰고, 조회하는 쪽은 읽기만 함) */
+typedef struct stats_block {
+    long counters[STAT_NCOUNTERS];
+    long hists[STAT_NHISTS][HIST_NBUCKETS];
+    long hist_sum[STAT_NHISTS];
+    struct stats_block *next;       /* 전체 목록 (해제하지 않음) */
+    struct stats_block *next_idle;
+} stats_block_t;
+
+static stats_block_t *all_blocks, *idle_blocks;
+static pthread_mutex_t block_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t block_key;
+static pthread_once_t block_once = PTHREAD_ONCE_INIT;
+static __thread stats_block_t *my_block;
+
+static void block_exit(void *arg)
+{
+    stats_block_t *b = arg;
+
+    my_block = NULL;
+    pthread_mutex_lock(&block_lock);
+    b->next_idle = idle_blocks;
+    idle_blocks = b;
+    pthread_mutex_unlock(&block_lock);
+}
+
+static void block_key_init(void)
+{
+    pthread_key_create(&block_key, block_exit);
+}
+
+static stats_block_t *get_block(void)
+{
+    stats_block_t *b;
+
+    if ((b = my_block))
+        return b;
+    pthread_once(&block_once, block_key_init);
+    pthread_mutex_lock(&block_lock);
+    if ((b = idle_blocks)) {
+        idle_blocks = b->next_idle;
+    } else {
+        b = Calloc(1, sizeof(stats_block_t));
+        b->next = all_blocks;
+        __atomic_store_n(&all_blocks, b, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&block_lock);
+    pthread_setspecific(block_key, b);
+    return my_block = b;
+}
+
+/* 단일 작성자 더하기: 읽는 쪽이 찢어진 값을 보지 않게 relaxed 읽기/쓰기 */
+static inline void local_add(long *p, long v)
+{
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static int hist_bucket(long v)
+{
+    if (v < HIST_SUB)
+        return v < 0 ? 0 : v;
+    int e = 63 - __builtin_clzl(v);
+    if (e > HIST_MAX_EXP)
+        return HIST_NBUCKETS - 1;
+    int sub = (v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+/* 칸의 하한 */
+static long hist_lower(int idx)
+{
+    if (idx < HIST_SUB)
+        return idx;
+    int e = idx / HIST_SUB + HIST_SUB_BITS - 1;
+    return (long)(HIST_SUB + idx % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+/* 칸에 드는 가장 큰 값 */
+static long hist_upper(int idx)
+{
+    return idx + 1 < HIST_NBUCKETS ? hist_lower(idx + 1) - 1 : LONG_MAX;
+}
+
+/* 칸의 대표값 (구간의 가운데) */
+static long hist_value(int idx)
+{
+    return idx < HIST_SUB ? idx : hist_lower(idx) + (hist_upper(idx) - hist_lower(idx) + 1) / 2;
+}
+
+void stats_inc(stat_id_t id)
+{
+    local_add(&get_block()->counters[id], 1);
+}
+
+void stats_add(stat_id_t id, long v)
+{
+    local_add(&get_block()->counters[id], v);
+}
+
+void stats_set_sampler(stat_id_t id, long (*fn)(void))
+{
+    samplers[id] = fn;
+}
+
+long stats_get(stat_id_t id)
+{
+    long v = 0;
+
+    if (samplers[id])
+        return samplers[id]();
+    for (stats_block_t *b = __atomic_load_n(&all_blocks, __ATOMIC_ACQUIRE); b; b = b->next)
+        v += __atomic_load_n(&b->counters[id], __ATOMIC_RELAXED);
+    return v;
+}
+
+long stats_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void stats_observe(hist_id_t id, long ns)
+{
+    stats_block_t *b = get_block();
+
+    local_add(&b->hists[id][hist_bucket(ns)], 1);
+    local_add(&b->hist_sum[id], ns);
+}
+
+/* 모든 스레드의 히스토그램을 합침. 총 개수를 리턴 */
+static long hist_merge(hist_id_t id, long *out, long *sum)
+{
+    long total = 0;
+
+    memset(out, 0, HIST_NBUCKETS * sizeof(long));
+    if (sum)
+        *sum = 0;
+    for (stats_block_t *b = __atomic_load_n(&all_blocks, __ATOMIC_ACQUIRE); b; b = b->next) {
+        for (int i = 0; i < HIST_NBUCKETS; i++) {
+            long n = __atomic_load_n(&b->hists[id][i], __ATOMIC_RELAXED);
+            out[i] += n;
+            total += n;
+        }
+        if (sum)
+            *sum += __atomic_load_n(&b->hist_sum[id], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+long stats_hist_count(hist_id_t id)
+{
+    long h[HIST_NBUCKETS];
+
+    return hist_merge(id, h, NULL);
+}
+
+static long percentile(const long *h, long total, double p)
+{
+    long rank = (long)(p / 100.0 * total), seen = 0;
+
+    if (total == 0)
+        return 0;
+    if (rank >= total)
+        rank = total - 1;
+    for (int i = 0; i < HIST_NBUCKETS; i++) {
+        seen += h[i];
+        if (seen > rank)
+            return hist_value(i);
+    }
+    return hist_value(HIST_NBUCKETS - 1);
+}
+
+long stats_percentile(hist_id_t id, double p)
+{
+    long h[HIST_NBUCKETS];
+    long total = hist_merge(id, h, NULL);
+
+    return percentile(h, total, p);
+}
+
+/* 현재/최대 RSS (kB), /proc/self/status에서 읽음 */
+static void dump_rss(FILE *fp)
+{
+    char line[MAXLINE];
+    FILE *st = fopen("/proc/self/status", "r");
+
+    if (!st)
+        return;
+    while (fgets(line, sizeof(line), st))
+        if (!strncmp(line, "VmRSS:", 6) || !strncmp(line, "VmHWM:", 6))
+            fputs(line, fp);
+    fclose(st);
+}
+
+void stats_dump(FILE *fp)
+{
+    long h[HIST_NBUCKETS], total;
+
+    for (int i = 0; i < STAT_NCOUNTERS; i++)
+        fprintf(fp, "%s %ld\n", counter_names[i], stats_get(i));
+    for (int i = 0; i < STAT_NHISTS; i++) {
+        total = hist_merge(i, h, NULL);
+        fprintf(fp, "%s_ns count=%ld p50=%ld p90=%ld p99=%ld p99.9=%ld\n",
+                hist_names[i], total, percentile(h, total, 50),
+                percentile(h, total, 90), percentile(h, total, 99),
+                percentile(h, total, 99.9));
+    }
+    alloc_dump(fp);
+    dump_rss(fp);
+    fflush(fp);
+}
+
+/* Prometheus 히스토그램 경계 (초) */
+static const double prom_le[] = {
+    1e-6, 1e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2,
+    2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10,
+};
+
+/*
+ * 텍스트 노출 형식. 카운터는 proxy_<이름>_total, 게이지는 proxy_<이름>,
+ * 히스토그램은 proxy_<이름>_seconds. 버킷 경계는 내부 칸(상대 오차 6%)
+ * 단위로 잘리므로 le 근처 값은 한 칸만큼 어긋날 수 있다.
+ */
+void stats_prometheus(FILE *fp)
+{
+    long h[HIST_NBUCKETS], total, sum;
+
+    for (int i = 0; i < STAT_NCOUNTERS; i++) {
+        const char *gauge = counter_is_gauge[i] ? "" : "_total";
+        fprintf(fp, "# TYPE proxy_%s%s %s\nproxy_%s%s %ld\n",
+                counter_names[i], gauge, counter_is_gauge[i] ? "gauge" : "counter",
+                counter_names[i], gauge, stats_get(i));
+    }
+    for (int i = 0; i < STAT_NHISTS; i++) {
+        total = hist_merge(i, h, &sum);
+        fprintf(fp, "# TYPE proxy_%s_seconds histogram\n", hist_names[i]);
+        long cum = 0;
+        int b = 0;
+        for (int k = 0; k < sizeof(prom_le) / sizeof(prom_le[0]); k++) {
+            long le_ns = (long)(prom_le[k] * 1e9);
+            for (; b < HIST_NBUCKETS && hist_upper(b) <= le_ns; b++)
+                cum += h[b];
+            fprintf(fp, "proxy_%s_seconds_bucket{le=\"%g\"} %ld\n",
+                    hist_names[i], prom_le[k], cum);
+        }
+        fprintf(fp, "proxy_%s_seconds_bucket{le=\"+Inf\"} %ld\n", hist_names[i], total);
+        fprintf(fp, "proxy_%s_seconds_sum %.9f\n", hist_names[i], sum / 1e9);
+        fprintf(fp, "proxy_%s_seconds_count %ld\n", hist_names[i], total);
+    }
+}
+
+/* SIGUSR1을 동기적으로 기다렸다가 통계를 출력 */
+static void *stats_dumper(void *vargp)
+{
+    sigset_t *mask = vargp;
+    int sig;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        if (sigwait(mask, &sig) == 0)
+            stats_dump(stderr);
+    }
+    return NULL;
+}
+
+void stats_start_dumper(void)
+{
+    static sigset_t mask;
+    pthread_t tid;
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGUSR1);
+    /* 이후 생성되는 스레드는 이 마스크를 물려받는다 */
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    Pthread_create(&tid, NULL, stats_dumper, &mask);
+}
@@ -0,0 +1,101 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "csapp.h"
+
+/* 프록시 통계 카운터 ID */
+typedef enum {
+    STAT_CONN_ACCEPTED,       /* 수락한 연결 수 */
+    STAT_CONN_DONE,           /* 처리를 마친 연결 수 */
+    STAT_ACCEPT_ERR,          /* accept() 실패 */
+    STAT_BAD_REQUEST,         /* 파싱할 수 없는 요청 */
+    STAT_CLIENT_READ_ERR,     /* 클라이언트 요청 읽기 실패 (ECONNRESET 등) */
+    STAT_CLIENT_WRITE_ERR,    /* 클라이언트 응답 쓰기 실패 (EPIPE 등) */
+    STAT_ORIGIN_CONNECT_ERR,  /* 원 서버 연결 실패 (DNS 포함) */
+    STAT_ORIGIN_WRITE_ERR,    /* 원 서버로 요청 전송 실패 */
+    STAT_ORIGIN_READ_ERR,     /* 원 서버 응답 읽기 실패 */
+    STAT_POOL_THREADS,        /* (게이지) 현재 워커 스레드 수 */
+    STAT_POOL_IDLE,           /* (게이지) 일감을 기다리는 워커 수 */
+    STAT_POOL_GROW,           /* 워커를 늘린 횟수 */
+    STAT_POOL_SHRINK,         /* 유휴 워커가 종료한 횟수 */
+    STAT_POOL_STEAL,          /* 다른 워커의 큐에서 훔쳐 온 연결 수 */
+    STAT_FAST_HIT,            /* fast lane에서 바로 응답한 캐시 히트 */
+    STAT_FAST_HANDOFF,        /* fast lane에서 워커 풀로 넘긴 연결 */
+    STAT_FAST_TIMEOUT,        /* 요청이 늦어 fast lane이 넘긴 연결 */
+    STAT_CORO_ACTIVE,         /* (게이지) 살아있는 코루틴 수 */
+    STAT_SHED_SLO,            /* 큐 대기가 SLO를 넘어 503으로 거절한 연결 */
+    STAT_SHED_IP,             /* IP별 동시 연결 상한으로 거절한 연결 */
+    STAT_SHED_FD,             /* fd가 바닥나 받자마자 닫은 연결 */
+    STAT_ACCEPT_BACKOFF,      /* EMFILE/ENFILE로 accept를 쉰 횟수 */
+    STAT_BUF_ALLOC,           /* 버퍼 풀의 malloc/realloc 호출 수 */
+    STAT_BUF_REUSE,           /* 스레드 풀에서 다시 꺼내 쓴 버퍼 수 */
+    STAT_BUF_BYTES,           /* (게이지) 버퍼 풀이 잡고 있는 바이트 */
+    STAT_LOG_DROPPED,         /* 링이 가득 차 버린 로그 줄 */
+    STAT_CACHE_HIT,           /* cache_find 히트 (fast lane 포함) */
+    STAT_CACHE_MISS,          /* cache_find 미스 */
+    STAT_CACHE_BYTES,         /* (게이지) 캐시에 든 객체 바이트 */
+    STAT_CACHE_EVICT,         /* 공간을 만들려고 퇴출한 객체 수 */
+    STAT_BYTES_SENT,          /* 클라이언트에 보낸 응답 바이트 */
+    STAT_QUEUE_DEPTH,         /* (게이지) 워커 큐에 쌓인 연결 수 (조회할 때 샘플) */
+    STAT_CACHE_RD_ACQ,        /* cache_lock 읽기 락 획득 */
+    STAT_CACHE_RD_CONTENDED,  /* 그중 바로 못 잡고 기다린 횟수 */
+    STAT_CACHE_WR_ACQ,        /* cache_lock 쓰기 락 획득 */
+    STAT_CACHE_WR_CONTENDED,
+    STAT_SBUF_CAS_RETRY,      /* sbuf 위치 CAS를 다른 스레드에게 뺏긴 횟수 */
+    STAT_SBUF_FULL_SLEEP,     /* 큐가 가득 차 생산자가 futex로 잠든 횟수 */
+    STAT_SBUF_EMPTY_SLEEP,    /* 큐가 비어 소비자가 futex로 잠든 횟수 */
+    STAT_NCOUNTERS
+} stat_id_t;
+
+/* 지연 히스토그램 ID (단위: ns) */
+typedef enum {
+    HIST_QUEUE_WAIT,          /* sbuf에 들어간 뒤 워커가 꺼낼 때까지 */
+    HIST_PARSE,               /* 요청 라인과 헤더를 읽고 파싱하는 데 걸린 시간 */
+    HIST_CACHE_FIND,          /* cache_find (히트면 전송 포함) */
+    HIST_CONNECT,             /* 원 서버 연결 (DNS 포함) */
+    HIST_TTFB,                /* 원 서버에 요청을 보낸 뒤 첫 응답 바이트까지 */
+    HIST_TOTAL,               /* 워커/코루틴이 연결을 잡고 끝낼 때까지 */
+    HIST_FAST_HIT,            /* fast lane 등록부터 캐시 히트 응답까지 */
+    HIST_ADMIT_WAIT,          /* 입장 검사 때 추정한 큐 대기 시간 */
+    HIST_CACHE_RD_WAIT,       /* cache_lock 읽기 락 대기 (경합했을 때만) */
+    HIST_CACHE_RD_HOLD,       /* 읽기 락 보유 (스레드마다 64번에 한 번 샘플) */
+    HIST_CACHE_WR_WAIT,       /* cache_lock 쓰기 락 대기 (경합했을 때만) */
+    HIST_CACHE_WR_HOLD,       /* 쓰기 락 보유 (샘플) */
+    HIST_SBUF_FULL_WAIT,      /* 가득 찬 큐 앞에서 생산자가 잠든 시간 */
+    STAT_NHISTS
+} hist_id_t;
+
+/*
+ * 카운터 조작 (모든 스레드에서 락 없이 호출 가능).
+ * 값은 스레드별 블록에 쌓이고 stats_get/출력할 때만 합쳐진다.
+ */
+void stats_inc(stat_id_t id);
+void stats_add(stat_id_t id, long v);
+long stats_get(stat_id_t id);
+
+/* 조회할 때마다 fn()으로 값을 읽는 게이지 (예: 큐 길이) */
+void stats_set_sampler(stat_id_t id, long (*fn)(void));
+
+/* 구간 측정용 단조 시계 (ns) */
+long stats_now_ns(void);
+
+/* 히스토그램에 값(ns) 하나 기록 */
+void stats_observe(hist_id_t id, long ns);
+
+/* 히스토그램의 p 백분위수 (0 <= p <= 100), 기록이 없으면 0 */
+long stats_percentile(hist_id_t id, double p);
+long stats_hist_count(hist_id_t id);
+
+/* 현재 카운터/히스토그램 값과 RSS를 fp에 출력 */
+void stats_dump(FILE *fp);
+
+/* Prometheus 텍스트 형식으로 출력 (/metrics) */
+void stats_prometheus(FILE *fp);
+
+/*
+ * SIGUSR1을 받을 때마다 stderr로 통계를 출력하는 스레드 시작.
+ * 다른 스레드를 만들기 전에 호출해야 SIGUSR1이 모든 스레드에서 차단된다.
+ */
+void stats_start_dumper(void);
+
+#endif /* __STATS_H__ */
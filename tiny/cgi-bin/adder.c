@@ -1,47 +1,129 @@
 /*
 * adder.c - a minimal CGI program that adds two numbers together
+ *
+ * [수정] 환경 변수 TINY_CGIPOOL이 있으면 tiny의 CGI 워커 풀 모드
+ * (../cgipool.h): 표준 입력의 유닉스 소켓에서 요청 (환경 변수 묶음 +
+ * 클라이언트 소켓)을 하나씩 받아 처리하고 끝나지 않는다.
+ *
+ * [수정] -DTINY_HANDLER로 -shared 빌드하면 tiny가 dlopen 하는 핸들러
+ * (adder.so, ../handler.h) - 프로세스 없이 tiny 안에서 돈다.
  */
 #include "csapp.h"
 
-int main(void) {
+/* [수정] "a=1" 이든 "1" 이든 숫자 부분 */
+static int arg_value(const char *arg) {
+    const char *eq = strchr(arg, '=');
+
+    return strtol(eq ? eq + 1 : arg, NULL, 10);
+}
+
+/*
+ * [수정] 응답 (헤더 + 빈 줄 + 본문) 을 out에 만든다. 리턴: 응답 길이
+ * (len보다 크면 잘렸음). CGI, 풀 워커, tiny 핸들러가 같이 쓴다.
+ * 핸들러는 tiny 안에서 돌므로 '&'가 없는 요청에도 죽으면 안 된다
+ */
+static int add(const char *query, char *out, size_t len) {
     // volatile int i = 0;
     // while (i == 0) {
         // sleep(1);
     // }
 
-    char *buf, *p;
-    char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE];
+    const char *p;
+    char arg1[MAXLINE], content[MAXLINE];
     int n1 = 0, n2 = 0;
 
     /* Extract the two arguments */
-    if ((buf = getenv("QUERY_STRING")) != NULL) {
-        p = strchr(buf, '&');
-        *p = '\0';
-
-        strcpy(arg1, buf);
-        strcpy(arg2, p + 1);
+    if (query != NULL && (p = strchr(query, '&')) != NULL) {
+        snprintf(arg1, sizeof(arg1), "%.*s", (int) (p - query), query);
 
         // n1 = atoi(arg1);
         // n2 = atoi(arg2);
         // For homework 11.10
-        n1 = strtol(strchr(arg1, '=') + 1, NULL, 10);
-        n2 = strtol(strchr(arg2, '=') + 1, NULL, 10);
+        n1 = arg_value(arg1);
+        n2 = arg_value(p + 1);
     }
 
     /* Make the response body */
-    sprintf(content, "QUERY_STRING=%s", buf);
-    sprintf(content, "Welcome to add.com: ");
-    sprintf(content, "%sTHE Internet addition portal.\r\n<p>", content);
-    sprintf(content, "%sThe answer is: %d + %d = %d\r\n<p>",
-            content, n1, n2, n1 + n2);
-    sprintf(content, "%sThanks for visiting!\r\n", content);
+    snprintf(content, sizeof(content), "Welcome to add.com: "
+             "THE Internet addition portal.\r\n<p>"
+             "The answer is: %d + %d = %d\r\n<p>"
+             "Thanks for visiting!\r\n", n1, n2, n1 + n2);
 
     /* Generate the HTTP response */
-    printf("Connection: close\r\n");
-    printf("Content-length: %d\r\n", (int) strlen(content));
-    printf("Content-type: text/html\r\n\r\n");
-    printf("%s", content);
+    return snprintf(out, len, "Connection: close\r\n"
+                    "Content-length: %d\r\n"
+                    "Content-type: text/html\r\n\r\n%s",
+                    (int) strlen(content), content);
+}
+
+#ifdef TINY_HANDLER
+#include "handler.h"
+
+/* [수정] tiny가 dlopen 해서 부르는 핸들러 (make adder.so, ../handler.h) */
+int tiny_handle(const char *method, const char *query, char *buf, size_t buflen) {
+    return add(query, buf, buflen);
+}
+#else
+/*
+ * [수정] 풀 모드에서 다음 요청을 받는다: 환경 변수를 설정하고 클라이언트
+ * 소켓을 표준 출력으로. tiny가 끝나서 소켓이 닫혔으면 -1
+ */
+static int next_request(void) {
+    char msg[2 * MAXLINE], cbuf[CMSG_SPACE(sizeof(int))], *p, *eq;
+    struct iovec iov = {msg, sizeof(msg) - 1};
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    ssize_t n;
+    int cfd;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+    while ((n = recvmsg(STDIN_FILENO, &mh, 0)) < 0)
+        if (errno != EINTR)
+            return -1;
+    if (n == 0)
+        return -1;
+    if ((cm = CMSG_FIRSTHDR(&mh)) == NULL || cm->cmsg_type != SCM_RIGHTS)
+        return 0;       // fd 없는 메시지 - 무시 (응답할 곳이 없음)
+    memcpy(&cfd, CMSG_DATA(cm), sizeof(int));
+
+    msg[n] = '\0';
+    for (p = msg; p < msg + n; p += strlen(p) + 1)
+        if ((eq = strchr(p, '=')) != NULL) {
+            *eq = '\0';
+            setenv(p, eq + 1, 1);
+        }
+    dup2(cfd, STDOUT_FILENO);
+    close(cfd);
+    return 1;
+}
+
+/* CGI / 풀 워커: 만든 응답을 표준 출력으로 */
+static void respond(void) {
+    char resp[MAXBUF];
+    int n = add(getenv("QUERY_STRING"), resp, sizeof(resp));
+
+    fwrite(resp, 1, n < (int) sizeof(resp) ? n : (int) sizeof(resp) - 1, stdout);
     fflush(stdout);
+}
+
+int main(void) {
+    int nullfd, rc;
 
+    if (!getenv("TINY_CGIPOOL")) {
+        respond();
+        exit(0);
+    }
+    nullfd = open("/dev/null", O_WRONLY);
+    while ((rc = next_request()) >= 0) {
+        if (rc == 0)
+            continue;
+        respond();
+        dup2(nullfd, STDOUT_FILENO);    // 클라이언트 소켓을 닫아 응답을 끝냄
+    }
     exit(0);
 }
+#endif
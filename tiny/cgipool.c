@@ -0,0 +1,230 @@
+/*
+ * cgipool.c - 오래 사는 CGI 워커 풀 (cgipool.h 참고)
+ *
+ * 풀은 그 프로그램의 첫 요청 때 만든다. 워커 자리마다 감시 스레드가
+ * 하나씩 있어서 워커를 띄우고 waitpid로 기다렸다가 다시 띄운다 (자기
+ * 자식 pid만 기다리므로 serve_dynamic의 fork 자식과 섞이지 않음).
+ *
+ * 워커가 요청을 처리하다 죽으면 그 클라이언트는 응답이 잘린 채 끊기고,
+ * 소켓에 쌓여 있던 다른 요청은 살아 있는 (또는 새로 뜬) 워커가 받는다.
+ */
+#include "cgipool.h"
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define CP_RESPAWN_US 10000     /* 연달아 죽을 때 다시 띄우기 전 쉬는 시간 */
+
+typedef struct {
+    char path[MAXLINE];
+    int sv[2];                  // sv[0]: tiny가 보내는 쪽, sv[1]: 워커들의 fd 0
+    char **envp;                // 워커의 환경 (tiny의 환경 + CGIPOOL_ENV)
+    int fails;                  // 정상 종료한 워커 수
+    int broken;                 // 1이면 이 프로그램은 fork로
+} cgipool_t;
+
+static int cp_nworkers;
+static int cp_maxfd;            // close_range가 없을 때 닫아 볼 fd 상한
+static cgipool_t *cp_pools[CP_MAX_PROGS];
+static int cp_npools;
+static pthread_mutex_t cp_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void cgipool_init(int nworkers) {
+    struct rlimit rl;
+
+    cp_nworkers = nworkers;
+    cp_maxfd = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+               ? rl.rlim_cur : 65536;
+}
+
+/*
+ * [수정] exec 할 자식에서 0~2 말고 다 닫는다. tiny의 fd는 CLOEXEC가
+ * 아니라서 (리슨 소켓, 다른 스레드가 받은 클라이언트 소켓, 캐시가 열어
+ * 둔 파일) 오래 사는 워커가 물고 있으면 tiny가 닫아도 클라이언트는
+ * EOF를 못 받는다. fork 뒤에 부르므로 시스템 콜만.
+ */
+static void cp_close_fds(void) {
+    if (syscall(SYS_close_range, 3, ~0U, 0) == 0)
+        return;
+    for (int fd = 3; fd < cp_maxfd; fd++)
+        close(fd);
+}
+
+/* fork 뒤에는 exec 전까지 async-signal-safe 호출만 (다른 스레드가 락을 쥐고 있을 수 있음) */
+static pid_t cp_spawn(cgipool_t *p) {
+    char *argv[] = {p->path, NULL};
+    pid_t pid;
+    int nullfd;
+
+    if ((pid = fork()) != 0)
+        return pid;
+    signal(SIGPIPE, SIG_DFL);   // tiny의 SIG_IGN은 exec 뒤에도 남는다
+    if ((nullfd = open("/dev/null", O_RDWR)) < 0 ||
+        dup2(p->sv[1], STDIN_FILENO) < 0 || dup2(nullfd, STDOUT_FILENO) < 0)
+        _exit(127);
+    cp_close_fds();
+    execve(p->path, argv, p->envp);
+    _exit(127);
+}
+
+/* 풀에 쌓여 있던 요청 하나를 예전처럼 fork/exec로 처리 (msg의 변수가 앞에 오게) */
+static void cp_fork_one(cgipool_t *p, char *msg, int len, int cfd) {
+    char *argv[] = {p->path, NULL}, **envp, *v;
+    int n = 0, i = 0;
+    pid_t pid;
+
+    while (p->envp[n])
+        n++;
+    envp = Malloc((n + 3) * sizeof(char *));
+    for (v = msg; v < msg + len && i < 2; v += strlen(v) + 1)
+        envp[i++] = v;
+    memcpy(envp + i, p->envp, (n + 1) * sizeof(char *));
+    if ((pid = fork()) == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        dup2(cfd, STDOUT_FILENO);
+        cp_close_fds();
+        execve(p->path, argv, envp);
+        _exit(127);
+    }
+    Free(envp);
+    close(cfd);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+}
+
+/* 이 프로그램은 풀로 못 돌림: 보내는 쪽을 막고 쌓여 있던 요청은 fork로 */
+static void cp_break(cgipool_t *p) {
+    char msg[CP_MSG_MAX], cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {msg, sizeof(msg) - 1};
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    ssize_t n;
+    int cfd;
+
+    if (__atomic_exchange_n(&p->broken, 1, __ATOMIC_ACQ_REL))
+        return;
+    fprintf(stderr, "cgipool: %s does not run as a pool worker, using fork\n", p->path);
+    shutdown(p->sv[0], SHUT_RDWR);
+    while (1) {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = cbuf;
+        mh.msg_controllen = sizeof(cbuf);
+        if ((n = recvmsg(p->sv[1], &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) <= 0)
+            break;
+        if ((cm = CMSG_FIRSTHDR(&mh)) == NULL || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        memcpy(&cfd, CMSG_DATA(cm), sizeof(int));
+        msg[n] = '\0';
+        cp_fork_one(p, msg, n, cfd);
+    }
+}
+
+/* 워커 자리 하나: 띄우고, 죽으면 다시 띄운다 */
+static void *cp_supervise(void *vargp) {
+    cgipool_t *p = vargp;
+    pid_t pid;
+    int status;
+
+    Pthread_detach(pthread_self());
+    while (!__atomic_load_n(&p->broken, __ATOMIC_ACQUIRE)) {
+        if ((pid = cp_spawn(p)) < 0) {
+            sleep(1);
+            continue;
+        }
+        while (waitpid(pid, &status, 0) < 0)
+            if (errno != EINTR)
+                return NULL;
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "cgipool: %s (pid %d) killed by signal %d, restarting\n",
+                    p->path, (int) pid, WTERMSIG(status));
+            usleep(CP_RESPAWN_US);
+            continue;
+        }
+        if (__atomic_add_fetch(&p->fails, 1, __ATOMIC_ACQ_REL) >= CP_MAX_FAILS)
+            cp_break(p);
+    }
+    return NULL;
+}
+
+static cgipool_t *cp_create(const char *filename) {
+    cgipool_t *p = Malloc(sizeof(cgipool_t));
+    pthread_t tid;
+    int n = 0;
+
+    memset(p, 0, sizeof(*p));
+    snprintf(p->path, sizeof(p->path), "%s", filename);
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, p->sv) < 0) {
+        Free(p);
+        return NULL;
+    }
+    while (environ[n])
+        n++;
+    p->envp = Malloc((n + 2) * sizeof(char *));
+    memcpy(p->envp, environ, n * sizeof(char *));
+    p->envp[n] = CGIPOOL_ENV "=1";
+    p->envp[n + 1] = NULL;
+    for (int i = 0; i < cp_nworkers; i++)
+        Pthread_create(&tid, NULL, cp_supervise, p);
+    return p;
+}
+
+/* 이미 있는 풀은 락 없이 찾는다 (한 번 넣은 자리는 바뀌지 않음) */
+static cgipool_t *cp_get(const char *filename) {
+    cgipool_t *p = NULL;
+    int i, n = __atomic_load_n(&cp_npools, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < n; i++)
+        if (!strcmp(cp_pools[i]->path, filename))
+            return cp_pools[i];
+
+    pthread_mutex_lock(&cp_mutex);
+    for (i = 0; i < cp_npools; i++)
+        if (!strcmp(cp_pools[i]->path, filename)) {
+            p = cp_pools[i];
+            goto out;
+        }
+    if (cp_npools < CP_MAX_PROGS && (p = cp_create(filename)) != NULL) {
+        cp_pools[cp_npools] = p;
+        __atomic_store_n(&cp_npools, cp_npools + 1, __ATOMIC_RELEASE);
+    }
+out:
+    pthread_mutex_unlock(&cp_mutex);
+    return p;
+}
+
+int cgipool_run(const char *filename, int fd, const char *cgiargs, const char *method) {
+    char msg[CP_MSG_MAX], cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov;
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    cgipool_t *p;
+    int len;
+
+    if (cp_nworkers <= 0 || (p = cp_get(filename)) == NULL ||
+        __atomic_load_n(&p->broken, __ATOMIC_ACQUIRE))
+        return -1;
+    len = snprintf(msg, sizeof(msg), "QUERY_STRING=%s%cREQUEST_METHOD=%s%c",
+                   cgiargs, '\0', method, '\0');
+    if (len >= (int) sizeof(msg))
+        return -1;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = len;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+    cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+    /* 워커가 모두 바쁘면 소켓 버퍼가 찰 때까지 쌓이고, 그 뒤엔 여기서 기다린다 */
+    while (sendmsg(p->sv[0], &mh, MSG_NOSIGNAL) < 0)
+        if (errno != EINTR)
+            return -1;
+    return 0;
+}
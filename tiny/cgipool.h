@@ -0,0 +1,35 @@
+#ifndef CGIPOOL_H
+#define CGIPOOL_H
+
+#include "../csapp.h"
+
+/*
+ * cgipool - 요청마다 fork/exec 하는 대신 미리 띄워 둔 CGI 워커에 넘긴다
+ * (FastCGI처럼 오래 사는 프로세스)
+ *
+ * CGI 프로그램마다 SOCK_SEQPACKET 유닉스 소켓 쌍을 하나 만들고, 워커
+ * N개가 한쪽 끝을 표준 입력(fd 0)으로 물려받아 함께 읽는다. 요청 하나는
+ * 메시지 하나: 본문은 "이름=값\0" 환경 변수들, 클라이언트 소켓은
+ * SCM_RIGHTS로 같이 보낸다. 메시지는 워커 하나에게만 가고, 워커는
+ * 그 fd를 표준 출력으로 삼아 예전 CGI처럼 응답을 쓴 뒤 닫는다
+ * (tiny는 응답을 중계하지 않음).
+ *
+ * 워커는 환경 변수 CGIPOOL_ENV가 있으면 이 모드로 돈다 (cgi-bin/adder.c).
+ * 시그널로 죽은 워커는 다시 띄운다. 정상 종료는 이 모드를 모르는
+ * 프로그램이라는 뜻이라 CP_MAX_FAILS번이면 그 프로그램은 fork로 돌린다.
+ */
+#define CGIPOOL_ENV    "TINY_CGIPOOL"
+#define CP_MAX_PROGS   16               /* 풀을 만들 CGI 프로그램 수 */
+#define CP_MAX_FAILS   3
+#define CP_MSG_MAX     (2 * MAXLINE)    /* 환경 변수 묶음의 최대 길이 */
+
+/* 프로그램마다 띄울 워커 수 (0이면 끔 - 모두 fork) */
+void cgipool_init(int nworkers);
+
+/*
+ * filename의 풀에 요청을 넘긴다 (처음이면 풀을 만든다). 넘기면 0, 풀을
+ * 쓸 수 없으면 -1 (호출한 쪽이 fork로 처리). fd는 호출한 쪽이 닫는다
+ */
+int cgipool_run(const char *filename, int fd, const char *cgiargs, const char *method);
+
+#endif /* CGIPOOL_H */
@@ -0,0 +1,387 @@
+/*
+ * fcache.c - tiny의 정적 파일 캐시 (fcache.h 참고)
+ *
+ * 구조는 프록시의 cache.c와 같다: 해시 버킷으로 찾고, 이중 연결
+ * 리스트 꼬리부터 퇴출하고, 보내는 중인 엔트리는 참조 카운트로
+ * 지킨다 (지워져도 마지막 참조가 놓일 때 fd를 닫음).
+ *
+ * 무효화 경쟁: fcache_put은 감시를 먼저 건 뒤 fstat/본문 읽기를 하고,
+ * 그 사이 무효화가 한 번이라도 있었으면 (fc_inval_seq가 바뀜) 캐시에
+ * 넣지 않는다. 그래서 감시 전/읽는 중에 바뀐 내용이 남지 않는다.
+ */
+#include "fcache.h"
+#include <sys/inotify.h>
+#include <sys/resource.h>
+
+#define FC_BUCKETS   4096
+#define FC_MAX_WATCH 256
+#define FC_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | \
+                 IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static int fc_mode = FC_OFF;
+static pthread_rwlock_t fc_lock = PTHREAD_RWLOCK_INITIALIZER;
+static fc_entry_t *fc_index[FC_BUCKETS];
+static fc_entry_t *fc_head, *fc_tail;
+static int fc_count;
+static long fc_bytes;
+static int fc_nfd, fc_fd_max;           /* fd를 가진 엔트리 수와 그 상한 */
+static unsigned long fc_inval_seq;      /* 무효화할 때마다 증가 (원자적) */
+
+/* inotify 감시: wd → 디렉터리 (fc_watch_mutex) */
+static int fc_ifd = -1;
+static pthread_mutex_t fc_watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct { int wd; char *dir; } fc_watch[FC_MAX_WATCH];
+static int fc_nwatch;
+
+static unsigned fc_hash(const char *s) {
+    unsigned h = 2166136261u;               // FNV-1a
+    while (*s)
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h & (FC_BUCKETS - 1);
+}
+
+static void fc_put_ref(fc_entry_t *e) {
+    if (__atomic_sub_fetch(&e->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (e->fd >= 0)
+            close(e->fd);
+        Free(e->resp);
+        Free(e->path);
+        Free(e);
+    }
+}
+
+/* 목록과 색인에서 빼고 캐시의 참조를 놓는다 (쓰기 락 필요) */
+static void fc_unlink(fc_entry_t *e) {
+    fc_entry_t **pp = &fc_index[fc_hash(e->path)];
+
+    while (*pp != e)
+        pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        fc_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        fc_tail = e->prev;
+    fc_count--;
+    fc_bytes -= e->resplen;
+    if (e->fd >= 0)
+        fc_nfd--;
+    fc_put_ref(e);
+}
+
+static fc_entry_t *fc_lookup(const char *path) {
+    fc_entry_t *e;
+
+    for (e = fc_index[fc_hash(path)]; e; e = e->hnext)
+        if (!strcmp(e->path, path))
+            return e;
+    return NULL;
+}
+
+/* path 하나를 지운다 (inotify 스레드, FC_MTIME 검사) */
+static void fc_invalidate(const char *path) {
+    fc_entry_t *e;
+
+    pthread_rwlock_wrlock(&fc_lock);
+    __atomic_add_fetch(&fc_inval_seq, 1, __ATOMIC_RELEASE);
+    if ((e = fc_lookup(path)) != NULL)
+        fc_unlink(e);
+    pthread_rwlock_unlock(&fc_lock);
+}
+
+/*
+ * [수정] path가 바뀌면 그 파일의 gzip 엔트리도 지운다. path가 미리
+ * 압축한 foo.gz 이면 foo의 gzip 엔트리도 (그 파일을 보내고 있었을 수 있음)
+ */
+static void fc_invalidate_all(const char *path) {
+    char key[MAXLINE + sizeof(FC_GZ_KEY)];
+    size_t n = strlen(path);
+
+    fc_invalidate(path);
+    snprintf(key, sizeof(key), "%s" FC_GZ_KEY, path);
+    fc_invalidate(key);
+    if (n > 3 && !strcmp(path + n - 3, ".gz")) {
+        snprintf(key, sizeof(key), "%.*s" FC_GZ_KEY, (int) (n - 3), path);
+        fc_invalidate(key);
+    }
+}
+
+static void fc_flush(void) {
+    pthread_rwlock_wrlock(&fc_lock);
+    __atomic_add_fetch(&fc_inval_seq, 1, __ATOMIC_RELEASE);
+    while (fc_tail)
+        fc_unlink(fc_tail);
+    pthread_rwlock_unlock(&fc_lock);
+}
+
+/* path가 든 디렉터리를 감시 (이미 감시 중이면 그대로). 실패하면 -1 */
+static int fc_watch_dir(const char *path) {
+    char dir[MAXLINE];
+    const char *slash = strrchr(path, '/');
+    int wd, rc = 0;
+
+    if (!slash)
+        strcpy(dir, ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+
+    pthread_mutex_lock(&fc_watch_mutex);
+    for (int i = 0; i < fc_nwatch; i++)
+        if (!strcmp(fc_watch[i].dir, dir))
+            goto out;
+    if (fc_nwatch == FC_MAX_WATCH || (wd = inotify_add_watch(fc_ifd, dir, FC_MASK)) < 0) {
+        rc = -1;
+        goto out;
+    }
+    fc_watch[fc_nwatch].wd = wd;
+    fc_watch[fc_nwatch].dir = strdup(dir);
+    fc_nwatch++;
+out:
+    pthread_mutex_unlock(&fc_watch_mutex);
+    return rc;
+}
+
+/* inotify 이벤트를 읽어 바뀐 파일을 지우는 스레드 */
+static void *fc_notify_thread(void *vargp) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[MAXLINE];
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        ssize_t n = read(fc_ifd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            fc_flush();         // 더 이상 감시할 수 없음 - 비우고 끈다
+            fc_mode = FC_OFF;
+            return NULL;
+        }
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *ev = (struct inotify_event *) p;
+            const char *dir = NULL;
+
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                /* 이벤트를 놓쳤거나 디렉터리 자체가 바뀜 - 통째로 비운다 */
+                pthread_mutex_lock(&fc_watch_mutex);
+                for (int i = 0; i < fc_nwatch; i++)
+                    if (fc_watch[i].wd == ev->wd && (ev->mask & IN_IGNORED)) {
+                        free(fc_watch[i].dir);
+                        fc_watch[i] = fc_watch[--fc_nwatch];
+                        break;
+                    }
+                pthread_mutex_unlock(&fc_watch_mutex);
+                fc_flush();
+                continue;
+            }
+            if (ev->len == 0)
+                continue;
+            pthread_mutex_lock(&fc_watch_mutex);
+            for (int i = 0; i < fc_nwatch; i++)
+                if (fc_watch[i].wd == ev->wd) {
+                    dir = fc_watch[i].dir;
+                    snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+                    break;
+                }
+            pthread_mutex_unlock(&fc_watch_mutex);
+            if (dir)
+                fc_invalidate_all(path);
+        }
+    }
+}
+
+int fcache_init(int mode) {
+    pthread_t tid;
+    struct rlimit rl;
+
+    /* 나머지 fd는 연결, CGI 파이프, 보내는 중인 파일 몫 */
+    fc_fd_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+                ? rl.rlim_cur / FC_FD_SHARE : 65536;
+
+    if (mode == FC_INOTIFY) {
+        if ((fc_ifd = inotify_init1(IN_CLOEXEC)) < 0)
+            mode = FC_MTIME;    // inotify가 없으면 stat으로 검사
+        else
+            Pthread_create(&tid, NULL, fc_notify_thread, NULL);
+    }
+    fc_mode = mode;
+    return mode;
+}
+
+fc_entry_t *fcache_get(const char *path) {
+    fc_entry_t *e;
+    struct stat sb;
+
+    if (fc_mode == FC_OFF)
+        return NULL;
+    pthread_rwlock_rdlock(&fc_lock);
+    if ((e = fc_lookup(path)) != NULL)
+        __atomic_add_fetch(&e->refcnt, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&fc_lock);
+
+    if (e && fc_mode == FC_MTIME &&
+        (stat(path, &sb) < 0 || sb.st_size != e->size || sb.st_ino != e->ino ||
+         sb.st_mtim.tv_sec != e->mtime.tv_sec || sb.st_mtim.tv_nsec != e->mtime.tv_nsec)) {
+        fc_invalidate(path);
+        fc_put_ref(e);
+        return NULL;
+    }
+    return e;
+}
+
+fc_entry_t *fcache_get_gz(const char *path) {
+    char key[MAXLINE + sizeof(FC_GZ_KEY)];
+
+    if (fc_mode != FC_INOTIFY)
+        return NULL;
+    snprintf(key, sizeof(key), "%s" FC_GZ_KEY, path);
+    return fcache_get(key);
+}
+
+/* 감시를 먼저 걸고 무효화 순번을 읽는다. 캐시에 넣을 수 있으면 1 */
+static int fc_begin(const char *path, unsigned long *seq) {
+    int cacheable = fc_mode != FC_OFF;
+
+    if (fc_mode == FC_INOTIFY && fc_watch_dir(path) < 0)
+        cacheable = 0;
+    *seq = __atomic_load_n(&fc_inval_seq, __ATOMIC_ACQUIRE);
+    return cacheable;
+}
+
+/* sb (헤더를 만들 때의 stat) 뒤로 파일이 바뀌었는지 */
+static int fc_changed(struct stat *now, struct stat *sb) {
+    return now->st_size != sb->st_size ||
+           now->st_mtim.tv_sec != sb->st_mtim.tv_sec || now->st_mtim.tv_nsec != sb->st_mtim.tv_nsec;
+}
+
+/*
+ * 엔트리를 만든다: fd >= 0이면 그 파일이 본문 (작으면 읽어 붙이고 닫음),
+ * 아니면 body[0..len). 다 못 읽었으면 *cacheable = 0
+ */
+static fc_entry_t *fc_new(const char *key, struct stat *sb, int fd, const char *body, long len,
+                          const char *hdr, int hdrlen, int *cacheable) {
+    fc_entry_t *e = Malloc(sizeof(fc_entry_t));
+
+    e->path = strdup(key);
+    e->size = sb->st_size;
+    e->mtime = sb->st_mtim;
+    e->ino = sb->st_ino;
+    e->gz = 0;
+    e->hdrlen = hdrlen;
+    e->refcnt = 1;              // 호출한 쪽의 참조
+    if (fd < 0) {
+        e->resp = Malloc(hdrlen + len);
+        memcpy(e->resp, hdr, hdrlen);
+        memcpy(e->resp + hdrlen, body, len);
+        e->resplen = hdrlen + len;
+        e->fd = -1;
+    } else if (e->size <= FC_INLINE_MAX) {
+        /* 작은 파일: 헤더 뒤에 본문까지 붙여 write 한 번으로 */
+        ssize_t got = 0, rc;
+        e->resp = Malloc(hdrlen + e->size);
+        memcpy(e->resp, hdr, hdrlen);
+        while (got < e->size && (rc = pread(fd, e->resp + hdrlen + got, e->size - got, got)) > 0)
+            got += rc;
+        if (got < e->size)
+            *cacheable = 0;     // 읽는 중에 줄어듦
+        e->resplen = hdrlen + got;
+        close(fd);
+        e->fd = -1;
+    } else {
+        e->resp = Malloc(hdrlen);
+        memcpy(e->resp, hdr, hdrlen);
+        e->resplen = hdrlen;
+        e->fd = fd;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);     // CGI 자식에게 넘어가지 않게
+    }
+    return e;
+}
+
+/* seq 뒤로 무효화가 없었으면 e를 캐시에 넣는다. e를 그대로 리턴 */
+static fc_entry_t *fc_insert(fc_entry_t *e, int cacheable, unsigned long seq) {
+    fc_entry_t *old;
+
+    if (!cacheable || e->resplen > FC_MAX_BYTES / 4)
+        return e;
+
+    pthread_rwlock_wrlock(&fc_lock);
+    if (__atomic_load_n(&fc_inval_seq, __ATOMIC_ACQUIRE) != seq) {
+        pthread_rwlock_unlock(&fc_lock);
+        return e;               // 읽는 사이 무효화가 있었음
+    }
+    if ((old = fc_lookup(e->path)) != NULL)
+        fc_unlink(old);         // 동시에 미스난 다른 스레드가 먼저 넣음
+    while (fc_tail && (fc_count >= FC_MAX_ENTRIES || fc_bytes + e->resplen > FC_MAX_BYTES))
+        fc_unlink(fc_tail);
+    /* fd를 가진 엔트리는 따로 센다: 오래된 것부터 그런 엔트리만 내보낸다 */
+    for (fc_entry_t *p = fc_tail, *prev; e->fd >= 0 && p && fc_nfd >= fc_fd_max; p = prev) {
+        prev = p->prev;
+        if (p->fd >= 0)
+            fc_unlink(p);
+    }
+    if (e->fd >= 0 && fc_nfd >= fc_fd_max) {
+        pthread_rwlock_unlock(&fc_lock);
+        return e;               // fd 상한이 0 (RLIMIT_NOFILE이 아주 작음)
+    }
+
+    e->refcnt++;                // 캐시의 참조
+    unsigned b = fc_hash(e->path);
+    e->hnext = fc_index[b];
+    fc_index[b] = e;
+    e->prev = NULL;
+    e->next = fc_head;
+    if (fc_head)
+        fc_head->prev = e;
+    fc_head = e;
+    if (!fc_tail)
+        fc_tail = e;
+    fc_count++;
+    fc_bytes += e->resplen;
+    if (e->fd >= 0)
+        fc_nfd++;
+    pthread_rwlock_unlock(&fc_lock);
+    return e;
+}
+
+fc_entry_t *fcache_put(const char *path, int fd, struct stat *sb,
+                       const char *hdr, int hdrlen) {
+    struct stat now;
+    unsigned long seq;
+    int cacheable = fc_begin(path, &seq);
+
+    if (fstat(fd, &now) < 0 || fc_changed(&now, sb))
+        cacheable = 0;          // 헤더를 만든 뒤에 바뀜
+    return fc_insert(fc_new(path, sb, fd, NULL, 0, hdr, hdrlen, &cacheable), cacheable, seq);
+}
+
+fc_entry_t *fcache_put_gz(const char *path, struct stat *sb, int fd, struct stat *gsb,
+                          const char *body, long len, const char *hdr, int hdrlen) {
+    char key[MAXLINE + sizeof(FC_GZ_KEY)];
+    struct stat now;
+    unsigned long seq;
+    fc_entry_t *e;
+    int cacheable;
+
+    /* FC_MTIME 모드는 원본과 .gz 둘 다 비교해야 하므로 넣지 않는다 */
+    snprintf(key, sizeof(key), "%s" FC_GZ_KEY, path);
+    cacheable = fc_begin(key, &seq) && fc_mode == FC_INOTIFY;
+    if (cacheable && (stat(path, &now) < 0 || fc_changed(&now, sb) ||
+                      (fd >= 0 && (fstat(fd, &now) < 0 || fc_changed(&now, gsb)))))
+        cacheable = 0;          // 헤더를 만든 뒤에 바뀜
+
+    if (!hdr) {                 // 압축하지 않음: 빈 엔트리로 기억만
+        if (cacheable)
+            fc_put_ref(fc_insert(fc_new(key, sb, -1, "", 0, "", 0, &cacheable), cacheable, seq));
+        return NULL;
+    }
+    e = fc_new(key, fd >= 0 ? gsb : sb, fd, body, len, hdr, hdrlen, &cacheable);
+    e->gz = 1;
+    return fc_insert(e, cacheable, seq);
+}
+
+void fcache_release(fc_entry_t *e) {
+    fc_put_ref(e);
+}
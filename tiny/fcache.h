@@ -0,0 +1,69 @@
+#ifndef FCACHE_H
+#define FCACHE_H
+
+#include "../csapp.h"
+
+/*
+ * fcache - tiny의 정적 파일 캐시 (열린 fd, stat 결과, 미리 만든 응답 헤더)
+ *
+ * 작은 파일 (FC_INLINE_MAX 이하)은 헤더 뒤에 본문까지 붙여 두어 write
+ * 한 번으로 응답하고, 큰 파일은 fd를 열어 둔 채 sendfile로 보낸다.
+ * 파일이 바뀌면 inotify (디렉터리 단위 감시) 로 지우고, inotify를 쓸 수
+ * 없거나 FC_MTIME 모드면 찾을 때마다 stat으로 mtime/크기/inode를 비교한다.
+ *
+ * [수정] gzip 응답은 "경로 + FC_GZ_KEY" 키의 별도 엔트리 (URI에는 공백이
+ * 없으므로 실제 파일과 겹치지 않음). inotify 모드에서만 넣고, 원본이나
+ * 미리 압축한 경로.gz 가 바뀌면 같이 지운다. 압축하지 않기로 한 파일도
+ * 기억해 두어 gzip 클라이언트가 매번 stat 하지 않게 한다.
+ */
+#define FC_INLINE_MAX   (64 * 1024)         /* 본문을 메모리에 둘 최대 크기 */
+#define FC_MAX_ENTRIES  1024                /* 엔트리 수의 상한 */
+#define FC_FD_SHARE     2                   /* 열어 둘 fd는 RLIMIT_NOFILE의 1/FC_FD_SHARE까지 */
+#define FC_MAX_BYTES    (32L * 1024 * 1024) /* 메모리에 둔 응답의 총량 */
+#define FC_GZ_KEY       " gzip"             /* gzip 엔트리 키의 접미사 */
+
+enum { FC_OFF, FC_INOTIFY, FC_MTIME };
+
+typedef struct fc_entry {
+    char *path;                 // 키 (parse_uri가 만든 filename)
+    int fd;                     // 열어 둔 파일 (-1: 본문이 resp에 있음)
+    off_t size;                 // 파일 크기
+    struct timespec mtime;      // FC_MTIME 모드에서 비교할 값
+    ino_t ino;                  // (gzip 엔트리는 검증자를 만든 파일의 stat)
+    int gz;                     // gzip 엔트리: 1 압축본, 0 압축하지 않음 (원본을 보낼 것)
+    char *resp;                 // 응답 헤더 [+ 본문]
+    int hdrlen, resplen;
+    int refcnt;                 // 캐시가 가진 1 + 지금 보내는 중인 수
+    struct fc_entry *prev, *next, *hnext;
+} fc_entry_t;
+
+/* mode: FC_OFF | FC_INOTIFY | FC_MTIME. 실제로 쓰게 된 모드를 리턴 */
+int fcache_init(int mode);
+
+/* 찾으면 참조를 잡아서 리턴 (다 쓰면 fcache_release), 없으면 NULL */
+fc_entry_t *fcache_get(const char *path);
+
+/*
+ * fd로 연 파일을 넣는다. hdr은 fd의 현재 크기로 만든 응답 헤더.
+ * fd의 소유권은 캐시로 넘어간다. 참조를 잡은 엔트리를 리턴
+ * (용량이 넘치거나 그 사이 파일이 바뀌었으면 캐시에 넣지 않고
+ * 이번 요청에만 쓰는 엔트리 - fcache_release가 정리)
+ */
+fc_entry_t *fcache_put(const char *path, int fd, struct stat *sb,
+                       const char *hdr, int hdrlen);
+
+/* path의 gzip 엔트리를 찾는다 (fcache_get과 같음) */
+fc_entry_t *fcache_get_gz(const char *path);
+
+/*
+ * path의 gzip 응답을 넣는다. sb는 원본의 stat. fd >= 0이면 미리 압축한
+ * 파일 (gsb는 그 stat, fd의 소유권은 캐시로), 아니면 body[0..len) 이
+ * 압축본. hdr == NULL이면 "압축하지 않음"만 기억하고 NULL 리턴. 참조를
+ * 잡은 엔트리를 리턴 (캐시에 못 넣으면 이번 요청에만 쓰는 엔트리)
+ */
+fc_entry_t *fcache_put_gz(const char *path, struct stat *sb, int fd, struct stat *gsb,
+                          const char *body, long len, const char *hdr, int hdrlen);
+
+void fcache_release(fc_entry_t *e);
+
+#endif /* FCACHE_H */
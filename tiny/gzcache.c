@@ -0,0 +1,211 @@
+/*
+ * gzcache.c - 즉석 gzip 압축 결과 캐시 (gzcache.h 참고)
+ *
+ * 구조는 fcache와 같다 (해시 버킷 + LRU 목록 + 참조 카운트). 찾을
+ * 때마다 LRU 순서를 바꾸므로 락은 뮤텍스 하나. 압축은 락 밖에서 하고,
+ * 같은 파일을 두 스레드가 동시에 압축했으면 나중 것이 앞의 것을 바꾼다.
+ */
+#include "gzcache.h"
+#include <zlib.h>
+
+#define GZ_BUCKETS 1024
+
+static pthread_mutex_t gz_mutex = PTHREAD_MUTEX_INITIALIZER;
+static gz_entry_t *gz_index[GZ_BUCKETS];
+static gz_entry_t *gz_head, *gz_tail;
+static long gz_bytes;
+
+/* 공백과 탭 건너뛰기 */
+static const char *skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+int gz_accepts(const char *value) {
+    const char *p = value, *end;
+    double gzip_q = -1, star_q = -1, q;
+    size_t n;
+
+    while (1) {
+        p = skip_ws(p);
+        n = strcspn(p, ",; \t\r\n");
+        end = p + strcspn(p, ",\r\n");
+        q = 1;
+        for (const char *s = p + n; s < end && (s = memchr(s, ';', end - s)) != NULL; ) {
+            s = skip_ws(s + 1);
+            if ((*s == 'q' || *s == 'Q') && s[1] == '=')
+                q = strtod(s + 2, NULL);
+        }
+        if ((n == 4 && !strncasecmp(p, "gzip", 4)) || (n == 6 && !strncasecmp(p, "x-gzip", 6)))
+            gzip_q = q;
+        else if (n == 1 && *p == '*')
+            star_q = q;
+        if (*end != ',')
+            break;
+        p = end + 1;
+    }
+    return gzip_q > 0 || (gzip_q < 0 && star_q > 0);
+}
+
+int gz_compressible(const char *filetype) {
+    return !strncmp(filetype, "text/", 5) ||
+           !strcmp(filetype, "application/javascript") ||
+           !strcmp(filetype, "application/json") ||
+           !strcmp(filetype, "image/svg+xml");
+}
+
+static unsigned gz_hash(const char *s) {
+    unsigned h = 2166136261u;               // FNV-1a
+    while (*s)
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h & (GZ_BUCKETS - 1);
+}
+
+static void gz_put_ref(gz_entry_t *e) {
+    if (__atomic_sub_fetch(&e->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (e->data)
+            Free(e->data);
+        Free(e->path);
+        Free(e);
+    }
+}
+
+static void gz_list_remove(gz_entry_t *e) {
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        gz_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        gz_tail = e->prev;
+}
+
+static void gz_list_push(gz_entry_t *e) {
+    e->prev = NULL;
+    e->next = gz_head;
+    if (gz_head)
+        gz_head->prev = e;
+    gz_head = e;
+    if (!gz_tail)
+        gz_tail = e;
+}
+
+/* 총량에 세는 크기 (줄지 않은 파일의 기록도 자리를 차지함) */
+static long gz_cost(gz_entry_t *e) {
+    return e->len + sizeof(gz_entry_t) + strlen(e->path);
+}
+
+/* 목록과 색인에서 빼고 캐시의 참조를 놓는다 (gz_mutex 필요) */
+static void gz_unlink(gz_entry_t *e) {
+    gz_entry_t **pp = &gz_index[gz_hash(e->path)];
+
+    while (*pp != e)
+        pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    gz_list_remove(e);
+    gz_bytes -= gz_cost(e);
+    gz_put_ref(e);
+}
+
+static int gz_fresh(gz_entry_t *e, struct stat *sb) {
+    return e->ino == sb->st_ino && e->size == sb->st_size &&
+           e->mtime.tv_sec == sb->st_mtim.tv_sec && e->mtime.tv_nsec == sb->st_mtim.tv_nsec;
+}
+
+/* 파일 전체를 gzip으로 압축. 줄지 않았거나 읽기 실패면 *out = NULL */
+static long gz_compress(const char *filename, struct stat *sb, char **out) {
+    z_stream zs;
+    char *src, *dst;
+    ssize_t got = 0, rc;
+    uLong bound;
+    int fd;
+
+    *out = NULL;
+    if ((fd = open(filename, O_RDONLY)) < 0)
+        return 0;
+    src = Malloc(sb->st_size);
+    while (got < sb->st_size && (rc = pread(fd, src + got, sb->st_size - got, got)) > 0)
+        got += rc;
+    close(fd);
+    if (got < sb->st_size) {
+        Free(src);
+        return 0;
+    }
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, GZ_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        Free(src);
+        return 0;
+    }
+    bound = deflateBound(&zs, got);
+    dst = Malloc(bound);
+    zs.next_in = (Bytef *) src;
+    zs.avail_in = got;
+    zs.next_out = (Bytef *) dst;
+    zs.avail_out = bound;
+    rc = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    Free(src);
+    if (rc != Z_STREAM_END || (off_t) zs.total_out >= sb->st_size) {
+        Free(dst);
+        return 0;
+    }
+    *out = Realloc(dst, zs.total_out);
+    return zs.total_out;
+}
+
+gz_entry_t *gzcache_get(const char *filename, struct stat *sb) {
+    gz_entry_t *e, *ret, **pp;
+    unsigned b = gz_hash(filename);
+
+    if (sb->st_size < GZ_MIN_SIZE || sb->st_size > GZ_SRC_MAX)
+        return NULL;
+
+    pthread_mutex_lock(&gz_mutex);
+    for (e = gz_index[b]; e; e = e->hnext)
+        if (!strcmp(e->path, filename))
+            break;
+    if (e && gz_fresh(e, sb)) {
+        gz_list_remove(e);
+        gz_list_push(e);
+        if (e->data)
+            e->refcnt++;
+        else
+            e = NULL;           // 참조 없이는 락 밖에서 만지지 않는다
+        pthread_mutex_unlock(&gz_mutex);
+        return e;
+    }
+    if (e)
+        gz_unlink(e);           // 원본이 바뀜
+    pthread_mutex_unlock(&gz_mutex);
+
+    e = Malloc(sizeof(gz_entry_t));
+    e->path = strdup(filename);
+    e->ino = sb->st_ino;
+    e->size = sb->st_size;
+    e->mtime = sb->st_mtim;
+    e->len = gz_compress(filename, sb, &e->data);
+    e->refcnt = e->data ? 2 : 1;    // 캐시 + (압축됐으면) 호출한 쪽
+    ret = e->data ? e : NULL;
+
+    pthread_mutex_lock(&gz_mutex);
+    for (pp = &gz_index[b]; *pp; pp = &(*pp)->hnext)
+        if (!strcmp((*pp)->path, filename)) {
+            gz_unlink(*pp);     // 동시에 미스난 다른 스레드가 먼저 넣음
+            break;
+        }
+    while (gz_tail && gz_bytes + gz_cost(e) > GZ_MAX_BYTES)
+        gz_unlink(gz_tail);
+    e->hnext = gz_index[b];
+    gz_index[b] = e;
+    gz_list_push(e);
+    gz_bytes += gz_cost(e);
+    pthread_mutex_unlock(&gz_mutex);
+    return ret;
+}
+
+void gzcache_release(gz_entry_t *e) {
+    gz_put_ref(e);
+}
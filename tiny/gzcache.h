@@ -0,0 +1,45 @@
+#ifndef GZCACHE_H
+#define GZCACHE_H
+
+#include "../csapp.h"
+
+/*
+ * gzcache - gzip 응답 (Accept-Encoding: gzip) 을 위한 즉석 압축과 그 결과 캐시
+ *
+ * 미리 압축한 foo.gz 가 있으면 tiny가 그걸 보내고, 없는 텍스트 파일만
+ * 여기서 zlib으로 압축한다. 결과는 원본의 inode/크기/mtime과 함께 두고
+ * (요청마다 tiny가 stat 한 값과 비교), 총량이 GZ_MAX_BYTES를 넘으면
+ * 오래 안 쓴 것부터 버린다. 압축해도 줄지 않는 파일은 그 사실만
+ * 기억해서 다시 압축하지 않는다.
+ */
+#define GZ_MIN_SIZE   256                   /* 이보다 작으면 압축하지 않음 */
+#define GZ_SRC_MAX    (4L * 1024 * 1024)    /* 즉석 압축할 원본의 최대 크기 */
+#define GZ_MAX_BYTES  (16L * 1024 * 1024)   /* 압축 결과의 총량 */
+#define GZ_LEVEL      6
+
+typedef struct gz_entry {
+    char *path;                 // 원본 경로 (키)
+    ino_t ino;                  // 압축할 때의 원본 stat
+    off_t size;
+    struct timespec mtime;
+    char *data;                 // gzip 본문 (NULL: 압축해도 줄지 않음)
+    long len;
+    int refcnt;                 // 캐시가 가진 1 + 지금 보내는 중인 수
+    struct gz_entry *prev, *next, *hnext;
+} gz_entry_t;
+
+/* Accept-Encoding 값이 gzip을 받는지 (q=0이면 안 받음) */
+int gz_accepts(const char *value);
+
+/* 압축할 만한 Content-type인지 (텍스트류) */
+int gz_compressible(const char *filetype);
+
+/*
+ * filename (sb는 방금 한 stat) 의 압축 결과. 참조를 잡아 리턴하고
+ * (다 쓰면 gzcache_release), 압축하지 않을 파일이면 NULL
+ */
+gz_entry_t *gzcache_get(const char *filename, struct stat *sb);
+
+void gzcache_release(gz_entry_t *e);
+
+#endif /* GZCACHE_H */
@@ -0,0 +1,20 @@
+#ifndef HANDLER_H
+#define HANDLER_H
+
+#include <stddef.h>
+
+/*
+ * tiny가 cgi-bin의 공유 객체 (.so) 를 dlopen 해서 부르는 핸들러의 형태
+ * (tiny/plugin.h). CGI 프로그램이 stdout에 쓰던 것 - 응답 헤더 몇 줄,
+ * 빈 줄, 본문 - 을 buf에 쓴다 (상태 줄은 tiny가 붙임).
+ *
+ * 리턴: 응답 길이. buflen보다 크면 아무것도 쓰지 않아도 되고, tiny가
+ * 그만큼의 버퍼로 다시 부른다 (snprintf처럼). -1이면 500.
+ * 여러 스레드에서 동시에 불리므로 전역 상태를 쓰면 안 된다.
+ */
+#define TINY_HANDLER_SYM "tiny_handle"
+
+typedef int (*tiny_handler_t)(const char *method, const char *query,
+                              char *buf, size_t buflen);
+
+#endif /* HANDLER_H */
@@ -0,0 +1,129 @@
+/*
+ * plugin.c - 공유 객체 핸들러 (plugin.h 참고)
+ *
+ * 경로마다 지금 버전 하나를 표에 두고, 부르는 동안은 참조 카운트로
+ * 지킨다 (fcache와 같은 방식). 표를 바꾸는 건 쓰기 락 안에서만.
+ *
+ * glibc의 dlopen은 이미 연 객체를 이름으로 찾아 그대로 돌려주므로,
+ * 같은 경로를 다시 열면 새 파일을 읽지 않는다. 그래서 파일을 열어
+ * 둔 fd의 /proc/self/fd/N 이름으로 dlopen 한다 - 옛 버전이 닫힐 때까지
+ * 그 fd도 열어 두므로 두 버전의 이름이 겹치지 않는다.
+ */
+#include "plugin.h"
+#include <dlfcn.h>
+
+typedef struct {
+    char path[MAXLINE];
+    void *dl;
+    int fd;                     // dlopen 이름이 겹치지 않게 열어 둔 파일
+    tiny_handler_t fn;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    int refcnt;                 // 표가 가진 1 + 지금 부르는 중인 수
+} plugin_t;
+
+static pthread_rwlock_t pl_lock = PTHREAD_RWLOCK_INITIALIZER;
+static plugin_t *pl_table[PLUGIN_MAX];
+static int pl_count;
+
+int plugin_is_handler(const char *filename) {
+    size_t n = strlen(filename);
+
+    return n > 3 && !strcmp(filename + n - 3, ".so");
+}
+
+static void pl_put_ref(plugin_t *p) {
+    if (__atomic_sub_fetch(&p->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        dlclose(p->dl);
+        close(p->fd);
+        Free(p);
+    }
+}
+
+static int pl_same(plugin_t *p, struct stat *sb) {
+    return p->ino == sb->st_ino && p->size == sb->st_size &&
+           p->mtime.tv_sec == sb->st_mtim.tv_sec && p->mtime.tv_nsec == sb->st_mtim.tv_nsec;
+}
+
+static plugin_t *pl_open(const char *filename, struct stat *sb) {
+    char name[64];
+    plugin_t *p = Malloc(sizeof(plugin_t));
+    struct stat now;
+
+    snprintf(p->path, sizeof(p->path), "%s", filename);
+    if ((p->fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0) {
+        Free(p);
+        return NULL;
+    }
+    snprintf(name, sizeof(name), "/proc/self/fd/%d", p->fd);
+    if ((p->dl = dlopen(name, RTLD_NOW | RTLD_LOCAL)) == NULL ||
+        (p->fn = (tiny_handler_t) dlsym(p->dl, TINY_HANDLER_SYM)) == NULL) {
+        fprintf(stderr, "plugin: %s: %s\n", filename, dlerror());
+        if (p->dl)
+            dlclose(p->dl);
+        close(p->fd);
+        Free(p);
+        return NULL;
+    }
+    /* stat 뒤에 바뀌었을 수도 있으니 실제로 연 파일 기준으로 */
+    if (fstat(p->fd, &now) == 0)
+        sb = &now;
+    p->ino = sb->st_ino;
+    p->size = sb->st_size;
+    p->mtime = sb->st_mtim;
+    p->refcnt = 1;
+    return p;
+}
+
+/* 참조를 잡은 지금 버전을 리턴 (필요하면 새로 연다). 실패 NULL */
+static plugin_t *pl_get(const char *filename, struct stat *sb) {
+    plugin_t *p = NULL, *np;
+    int i;
+
+    pthread_rwlock_rdlock(&pl_lock);
+    for (i = 0; i < pl_count; i++)
+        if (!strcmp(pl_table[i]->path, filename)) {
+            p = pl_table[i];
+            break;
+        }
+    if (p && pl_same(p, sb)) {
+        __atomic_add_fetch(&p->refcnt, 1, __ATOMIC_RELAXED);
+        pthread_rwlock_unlock(&pl_lock);
+        return p;
+    }
+    pthread_rwlock_unlock(&pl_lock);
+
+    pthread_rwlock_wrlock(&pl_lock);
+    for (i = 0; i < pl_count; i++)
+        if (!strcmp(pl_table[i]->path, filename))
+            break;
+    if (i < pl_count && pl_same(pl_table[i], sb)) {
+        np = pl_table[i];                   // 다른 스레드가 먼저 열었음
+    } else if (i == PLUGIN_MAX || (np = pl_open(filename, sb)) == NULL) {
+        np = i < pl_count ? pl_table[i] : NULL;    // 새 파일이 아직 덜 써졌으면 옛 버전으로
+    } else {
+        if (i < pl_count) {
+            fprintf(stderr, "plugin: reloaded %s\n", filename);
+            pl_put_ref(pl_table[i]);        // 부르는 중인 요청이 끝나면 닫힘
+        } else
+            pl_count++;
+        pl_table[i] = np;
+    }
+    if (np)
+        __atomic_add_fetch(&np->refcnt, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&pl_lock);
+    return np;
+}
+
+int plugin_run(const char *filename, struct stat *sb, const char *method,
+               const char *query, char *buf, size_t buflen) {
+    plugin_t *p;
+    int n;
+
+    if ((p = pl_get(filename, sb)) == NULL)
+        return -1;
+    n = p->fn(method, query, buf, buflen);
+    pl_put_ref(p);
+    return n;
+}
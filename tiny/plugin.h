@@ -0,0 +1,34 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "../csapp.h"
+#include "handler.h"
+
+/*
+ * plugin - cgi-bin의 .so 핸들러를 tiny 프로세스 안에서 부른다 (fork도
+ * IPC도 없음). 핸들러의 형태는 handler.h.
+ *
+ * 처음 부를 때 dlopen 하고, 그 뒤로는 doit이 이미 한 stat 결과의
+ * inode/크기/mtime이 달라지면 새로 연다 (핫 리로드). 옛 버전은 그걸
+ * 부르는 중인 요청이 다 끝나야 dlclose 된다. 새 파일을 열 수 없으면
+ * (덜 써졌거나 핸들러가 없음) 옛 버전을 계속 쓴다.
+ *
+ * 바꿀 때는 다른 이름으로 만들어 mv 할 것 (cgi-bin/Makefile처럼). 같은
+ * inode를 고쳐 쓰면 돌고 있는 코드가 바뀌고, 지웠다 다시 만들면 그
+ * 사이 요청은 404가 된다.
+ */
+#define PLUGIN_MAX     16               /* 올려 둘 수 있는 .so 수 */
+#define PLUGIN_RESP_MAX (1024 * 1024)   /* 핸들러 응답의 최대 길이 */
+
+/* filename이 핸들러 (.so) 이면 1 */
+int plugin_is_handler(const char *filename);
+
+/*
+ * sb는 filename의 stat 결과. buf에 응답 (헤더 + 빈 줄 + 본문) 을 쓰고
+ * 길이를 리턴 (buflen보다 크면 그 크기로 다시 부를 것), -1: 못 열었거나
+ * 핸들러가 실패
+ */
+int plugin_run(const char *filename, struct stat *sb, const char *method,
+               const char *query, char *buf, size_t buflen);
+
+#endif /* PLUGIN_H */
@@ -5,42 +5,298 @@
  *
  * Updated 11/2019 droh
  *   - Fixed sprintf() aliasing issue in serve_static(), and clienterror().
+ *
+ * [수정] 동시 처리 모드 (프록시 벤치마크에서 tiny가 먼저 병목이 되지 않도록)
+ *   usage: tiny [-t threads] [-e] [-q] <port>
+ *   -t N  미리 띄운 워커 스레드 N개가 같은 listenfd에서 각자 accept
+ *   -e    워커마다 epoll 루프: 요청 헤더가 다 올 때까지 (MSG_PEEK로 확인)
+ *         연결을 epoll에 두고, 다 오면 그 자리에서 doit. 느리게 보내는
+ *         클라이언트가 워커를 붙잡지 않는다 (응답 쓰기는 여전히 블로킹).
+ *         헤더가 덜 온 채 끊기거나 EP_TIMEOUT_MS 안에 다 오지 않으면 닫는다
+ *   -q    요청/응답 헤더를 stdout에 찍지 않음 (기본은 찍음)
+ *   -m    정적 파일을 예전처럼 mmap + Rio_writen으로 보냄 (비교용, 캐시 안 씀)
+ *   -c M  정적 파일 캐시 (fcache.h): inotify(기본) | mtime | off
+ *   -p N  CGI 프로그램마다 워커 N개를 미리 띄워 두고 요청을 넘김
+ *         (cgipool.h). 0(기본)이면 예전처럼 요청마다 fork/exec
+ *   옵션이 없으면 예전처럼 한 번에 한 연결.
+ *
+ * [수정] cgi-bin의 .so 파일은 프로세스를 띄우지 않고 tiny 안에서 dlopen 한
+ * 핸들러를 부른다 (plugin.h, 핸들러 형태는 handler.h). 파일이 바뀌면
+ * 다음 요청 때 새로 연다.
+ *
+ * [수정] Accept-Encoding: gzip 요청에는 텍스트 파일을 gzip으로 보낸다.
+ * 미리 압축한 foo.gz 가 있으면 그것을, 없으면 즉석 압축 결과 (gzcache.h,
+ * 크기 제한이 있는 캐시) 를. 압축할 만한 형식이면 응답에 Vary를 붙인다.
+ *
+ * [수정] 정적 파일 응답에 ETag (inode-크기-mtime) 와 Last-Modified를 붙이고,
+ * If-None-Match / If-Modified-Since가 맞으면 파일을 열지 않고 304로 답한다
+ * (캐시 히트면 stat도 없이 캐시 엔트리의 값으로).
+ *
+ * [수정] 정적 파일은 Range 요청에 206 (여러 구간이면 multipart/byteranges)
+ * 이나 416으로 답한다 (../range.c). 본문은 캐시의 메모리/fd, 매핑, 또는
+ * 파일에서 구간만 보낸다.
  */
 #include "../csapp.h"
+#include "../range.h"
+#include "fcache.h"
+#include "cgipool.h"
+#include "plugin.h"
+#include "gzcache.h"
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+
+#define EP_MAXEVENTS 64
+#define EP_TIMEOUT_MS 10000 /* [수정] 요청 헤더를 기다려 주는 시간 */
+#define EP_SWEEP_MS    1000 /* 오래된 연결을 확인하는 주기 */
+
+static int verbose = 1;     /* [수정] -q면 0 */
+static int use_mmap;        /* [수정] -m면 1 */
+static int fc_mode = FC_INOTIFY;    /* [수정] -c */
+
+/* [수정] 요청 헤더 중 tiny가 쓰는 것 (read_requesthdrs가 채움) */
+typedef struct {
+    char range[MAXLINE];        // Range 값 ("" 없음)
+    int gzip;                   // Accept-Encoding이 gzip을 받음
+    char inm[MAXLINE];          // If-None-Match 값 ("" 없음)
+    time_t ims;                 // If-Modified-Since (-1 없음)
+} reqhdrs_t;
+
+/* [수정] 응답 검증자 - stat 값만으로 만든다 */
+typedef struct {
+    char etag[64];              // 따옴표 포함 ("...")
+    char lastmod[64];           // HTTP 날짜
+} validators_t;
 
 void doit(int fd);
 
-void read_requesthdrs(rio_t *rp);
+void read_requesthdrs(rio_t *rp, reqhdrs_t *hdrs);
 
 int parse_uri(char *uri, char *filename, char *cgiargs);
 
-void serve_static(int fd, char *filename, int filesize, char *method);
+void serve_static(int fd, char *filename, struct stat *sbuf, char *method, reqhdrs_t *hdrs);
+
+static void serve_cached(int fd, fc_entry_t *e, char *filename, char *method, reqhdrs_t *hdrs);
+
+static int serve_gzip(int fd, char *filename, char *method, reqhdrs_t *hdrs);
 
 void get_filetype(char *filename, char *filetype);
 
 void serve_dynamic(int fd, char *filename, char *cgiargs, char *method);
 
+static void serve_plugin(int fd, char *filename, struct stat *sbuf, char *cgiargs, char *method);
+
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
 
-int main(int argc, char **argv) {
-    int listenfd, connfd;
+static void log_accept(struct sockaddr_storage *clientaddr, socklen_t clientlen) {
     char hostname[MAXLINE], port[MAXLINE];
+
+    if (!verbose)
+        return;
+    Getnameinfo((SA *) clientaddr, clientlen, hostname, MAXLINE,
+                port, MAXLINE, 0);
+    printf("Accepted connection from (%s, %s)\n", hostname, port);
+}
+
+/*
+ * [수정] 워커 풀 모드: 각 워커가 직접 accept (커널이 한 스레드만 깨움)
+ */
+static void *accept_worker(void *vargp) {
+    int listenfd = *(int *) vargp, connfd;
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;
 
+    while (1) {
+        clientlen = sizeof(clientaddr);
+        if ((connfd = accept(listenfd, (SA *) &clientaddr, &clientlen)) < 0) {
+            if (errno == EMFILE || errno == ENFILE)
+                usleep(10000);  // fd가 풀릴 때까지 - 바로 재시도하면 헛돈다
+            continue;   // ECONNABORTED 등 - 다른 연결은 계속 받는다
+        }
+        log_accept(&clientaddr, clientlen);
+        doit(connfd);
+        Close(connfd);
+    }
+    return NULL;
+}
+
+/*
+ * [수정] 요청 헤더가 다 들어왔는지 (또는 더 기다려도 소용없는지) 엿보기.
+ * 1: doit 해도 됨, 0: 더 기다림
+ */
+static int request_ready(int fd) {
+    char buf[MAXBUF];
+    ssize_t n = recv(fd, buf, sizeof(buf) - 1, MSG_PEEK | MSG_DONTWAIT);
+
+    if (n < 0)
+        return errno != EAGAIN && errno != EWOULDBLOCK;  // 오류면 doit이 정리
+    if (n == 0 || n == sizeof(buf) - 1)
+        return 1;       // 끊겼거나 버퍼보다 긴 헤더 - 그냥 읽게 둔다
+    buf[n] = '\0';
+    return strstr(buf, "\r\n\r\n") != NULL;
+}
+
+/*
+ * [수정] epoll 모드의 fd별 상태: 등록 시각 (0이면 epoll에 없음) 과 담당
+ * 워커의 epfd. 각 항목은 그 연결을 가진 워커만 쓴다 (fastlane.c와 같은 방식)
+ */
+static long *ep_since;
+static int *ep_owner;
+static int ep_max;          /* 표 크기 (RLIMIT_NOFILE) */
+static int ep_hi;           /* 지금까지 등록된 가장 큰 fd */
+
+static long now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/* epoll에서 빼고 시각을 지운다 (Close 전에 - fd가 재사용되므로) */
+static void ep_remove(int epfd, int fd) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (fd < ep_max)
+        __atomic_store_n(&ep_since[fd], 0, __ATOMIC_RELEASE);
+}
+
+/* 요청 헤더를 EP_TIMEOUT_MS 넘게 다 보내지 않은 이 워커의 연결을 닫는다 */
+static void ep_sweep(int epfd, long now) {
+    int hi = __atomic_load_n(&ep_hi, __ATOMIC_ACQUIRE);
+
+    for (int fd = 0; fd <= hi; fd++) {
+        long since = __atomic_load_n(&ep_since[fd], __ATOMIC_ACQUIRE);
+        if (since && ep_owner[fd] == epfd && now - since > EP_TIMEOUT_MS) {
+            ep_remove(epfd, fd);
+            Close(fd);
+        }
+    }
+}
+
+/*
+ * [수정] epoll 모드: 워커마다 자기 epoll에 listenfd(EPOLLEXCLUSIVE)와
+ * 아직 요청이 덜 온 연결들을 둔다.
+ * 연결은 엣지 트리거로 등록한다. 엿보기만 하므로 레벨 트리거면 이미 온
+ * 바이트 때문에 epoll_wait가 계속 바로 돌아와 워커가 헛돈다. 엣지 트리거면
+ * 새 바이트가 오거나 (EPOLLRDHUP) 끊길 때만 깨어난다.
+ */
+static void *epoll_worker(void *vargp) {
+    int listenfd = *(int *) vargp, epfd, connfd, n;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    struct epoll_event ev, events[EP_MAXEVENTS];
+    long last_sweep = now_ms(), now;
+
+    if ((epfd = epoll_create1(0)) < 0)
+        unix_error("epoll_create1 error");
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listenfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+        unix_error("epoll_ctl error");
+
+    while (1) {
+        if ((n = epoll_wait(epfd, events, EP_MAXEVENTS, EP_SWEEP_MS)) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd, ready;
+
+            if (fd == listenfd) {
+                /* listenfd는 논블로킹 - 밀린 연결을 다 받는다 */
+                while (1) {
+                    clientlen = sizeof(clientaddr);
+                    if ((connfd = accept(listenfd, (SA *) &clientaddr, &clientlen)) < 0) {
+                        if (errno == EMFILE || errno == ENFILE)
+                            usleep(10000);  // listenfd는 레벨 트리거 - 헛돌지 않게
+                        break;
+                    }
+                    log_accept(&clientaddr, clientlen);
+                    if (connfd < ep_max) {
+                        ep_owner[connfd] = epfd;
+                        __atomic_store_n(&ep_since[connfd], now_ms(), __ATOMIC_RELEASE);
+                        if (connfd > __atomic_load_n(&ep_hi, __ATOMIC_RELAXED))
+                            __atomic_store_n(&ep_hi, connfd, __ATOMIC_RELEASE);
+                    }
+                    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                    ev.data.fd = connfd;
+                    if (epoll_ctl(epfd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+                        ep_remove(epfd, connfd);
+                        Close(connfd);
+                    }
+                }
+                continue;
+            }
+            ready = request_ready(fd);
+            if (!ready && !(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                continue;       // 더 기다림
+            ep_remove(epfd, fd);
+            if (ready)
+                doit(fd);
+            Close(fd);          // 헤더가 덜 온 채 끊긴 연결은 그냥 닫는다
+        }
+        if ((now = now_ms()) - last_sweep >= EP_SWEEP_MS) {
+            ep_sweep(epfd, now);
+            last_sweep = now;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int listenfd, connfd, nthreads = 0, use_epoll = 0, cgi_workers = 0, c;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    pthread_t tid;
+
     /* Check command line args */
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    while ((c = getopt(argc, argv, "t:eqmc:p:")) != -1) {
+        switch (c) {
+            case 't': nthreads = atoi(optarg); break;
+            case 'e': use_epoll = 1; break;
+            case 'q': verbose = 0; break;
+            case 'm': use_mmap = 1; break;
+            case 'p': cgi_workers = atoi(optarg); break;
+            case 'c':
+                fc_mode = !strcmp(optarg, "off") ? FC_OFF :
+                          !strcmp(optarg, "mtime") ? FC_MTIME : FC_INOTIFY;
+                break;
+            default: optind = argc; break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-t threads] [-e] [-q] [-m] [-c inotify|mtime|off] [-p cgi_workers] <port>\n", argv[0]);
         exit(1);
     }
 
-    listenfd = Open_listenfd(argv[1]);
+    /* [수정] 보내는 중에 클라이언트가 끊으면 SIGPIPE 대신 EPIPE로 받는다 */
+    Signal(SIGPIPE, SIG_IGN);
+    fc_mode = fcache_init(use_mmap ? FC_OFF : fc_mode);
+    cgipool_init(cgi_workers);
+    listenfd = Open_listenfd(argv[optind]);
+    if (use_epoll) {
+        struct rlimit rl;
+
+        fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+        ep_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+                 ? rl.rlim_cur : 65536;
+        ep_since = Calloc(ep_max, sizeof(long));
+        ep_owner = Calloc(ep_max, sizeof(int));
+        if (nthreads < 1)
+            nthreads = 1;
+    }
+    if (nthreads > 0) {
+        /* [수정] 워커를 미리 띄우고 main은 잠만 잔다 */
+        for (int i = 0; i < nthreads; i++)
+            Pthread_create(&tid, NULL, use_epoll ? epoll_worker : accept_worker, &listenfd);
+        while (1)
+            pause();
+    }
+
     while (1) {
         clientlen = sizeof(clientaddr);
         connfd = Accept(listenfd, (SA *) &clientaddr, &clientlen);
-        Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE,
-                    port, MAXLINE, 0);
-        printf("Accepted connection from (%s, %s)\n", hostname, port);
+        log_accept(&clientaddr, clientlen);
         doit(connfd);
         Close(connfd);
     }
@@ -49,25 +305,47 @@ int main(int argc, char **argv) {
 void doit(int fd) {
     int is_static;
     struct stat sbuf;
+    fc_entry_t *e;
+    reqhdrs_t hdrs;
     char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
     char filename[MAXLINE], cgiargs[MAXLINE];
     rio_t rio;
 
     /* Read request line and headers */
     Rio_readinitb(&rio, fd);
-    Rio_readlineb(&rio, buf, MAXLINE);
-    printf("Request headers:\n");
-    printf("%s", buf);
-    sscanf(buf, "%s %s %s", method, uri, version);
+    /* [수정] Rio_readlineb는 클라이언트가 끊으면 exit - 이 연결만 포기 */
+    if (rio_readlineb(&rio, buf, MAXLINE) <= 0)
+        return;
+    if (verbose) {
+        printf("Request headers:\n");
+        printf("%s", buf);
+    }
+    if (sscanf(buf, "%s %s %s", method, uri, version) != 3) {
+        clienterror(fd, buf, "400", "Bad Request",
+                    "Tiny couldn't parse the request line");
+        return;
+    }
     if (strcasecmp(method, "GET") && strcasecmp(method, "HEAD")) {
         clienterror(fd, method, "501", "Not Implemented",
                     "Tiny does not implement this method");
         return;
     }
-    read_requesthdrs(&rio);
+    read_requesthdrs(&rio, &hdrs);
 
     /* Parse URI from GET request */
     is_static = parse_uri(uri, filename, cgiargs);
+
+    /* [수정] gzip을 받으면 텍스트는 압축본으로 (Range는 원본에만 적용) */
+    if (is_static && hdrs.gzip && !hdrs.range[0] && serve_gzip(fd, filename, method, &hdrs))
+        return;
+
+    /* [수정] 캐시에 있으면 stat/open/헤더 만들기 없이 바로 보낸다 */
+    if (is_static && (e = fcache_get(filename)) != NULL) {
+        serve_cached(fd, e, filename, method, &hdrs);
+        fcache_release(e);
+        return;
+    }
+
     if (stat(filename, &sbuf) < 0) {
         clienterror(fd, filename, "404", "Not found",
                     "Tiny couldn't find this file");
@@ -81,7 +359,7 @@ void doit(int fd) {
                         "Tiny couldn't read the file");
             return;
         }
-        serve_static(fd, filename, sbuf.st_size, method);
+        serve_static(fd, filename, &sbuf, method, &hdrs);
     } else {
         /* Serve dynamic content */
         if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
@@ -89,7 +367,10 @@ void doit(int fd) {
                         "Tiny couldn't run the CGI program");
             return;
         }
-        serve_dynamic(fd, filename, cgiargs, method);
+        if (plugin_is_handler(filename))
+            serve_plugin(fd, filename, &sbuf, cgiargs, method);
+        else
+            serve_dynamic(fd, filename, cgiargs, method);
     }
 }
 
@@ -118,29 +399,366 @@ int parse_uri(char *uri, char *filename, char *cgiargs) {
     }
 }
 
-void serve_static(int fd, char *filename, int filesize, char *method) {
+/*
+ * [수정] 헤더를 MSG_MORE로 보내서 커널이 본문 첫 부분과 합쳐 꽉 찬
+ * 패킷으로 내보내게 한다 (TCP_CORK를 켰다 끄는 setsockopt 두 번 대신)
+ */
+static int send_more(int fd, char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t rc = send(fd, buf, n, MSG_MORE | MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += rc;
+        n -= rc;
+    }
+    return 0;
+}
+
+/*
+ * [수정] 파일 → 소켓을 커널 안에서 복사 (mmap/munmap과 사용자 공간
+ * 복사가 없음). 소켓 버퍼가 차면 sendfile이 일부만 보내므로 반복.
+ * [off, off+len) 만 보낸다 (파일 오프셋은 건드리지 않음 - fd 공유 가능)
+ */
+static int send_file(int fd, int srcfd, off_t off, off_t len) {
+    off_t end = off + len;
+
+    while (off < end) {
+        ssize_t rc = sendfile(fd, srcfd, &off, end - off);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (rc == 0)
+            break;      // 파일이 그 사이 줄어듦
+    }
+    return 0;
+}
+
+/* [수정] 구간 본문 출처: 메모리 (mem) 또는 파일 (srcfd) */
+typedef struct {
+    char *mem;
     int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+} body_src_t;
+
+static int send_body(void *ctx, int fd, long off, long len) {
+    body_src_t *src = ctx;
 
-    /* Send response headers to client */
+    if (src->mem)
+        return rio_writen(fd, src->mem + off, len) < 0 ? -1 : 0;
+    return send_file(fd, src->srcfd, off, len);
+}
+
+/*
+ * [수정] ETag: inode-크기-mtime(ns) 16진수 (gzip 응답은 suffix "-gz" -
+ * 바이트가 다르므로 다른 태그). Last-Modified: mtime의 초 단위
+ */
+static void make_validators(validators_t *v, ino_t ino, off_t size,
+                            struct timespec mtime, const char *suffix) {
+    struct tm tm;
+
+    snprintf(v->etag, sizeof(v->etag), "\"%lx-%lx-%lx%s\"", (unsigned long) ino,
+             (unsigned long) size,
+             (unsigned long) mtime.tv_sec * 1000000000UL + mtime.tv_nsec, suffix);
+    strftime(v->lastmod, sizeof(v->lastmod), "%a, %d %b %Y %H:%M:%S GMT",
+             gmtime_r(&mtime.tv_sec, &tm));
+}
+
+/* "Sun, 06 Nov 1994 08:49:37 GMT" → time_t (형식이 다르면 -1) */
+static time_t parse_http_date(const char *s) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    struct tm tm;
+    char mon[4];
+    const char *m;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%*[^,], %d %3s %d %d:%d:%d", &tm.tm_mday, mon, &tm.tm_year,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 ||
+        (m = strstr(months, mon)) == NULL || (m - months) % 3)
+        return -1;
+    tm.tm_mon = (m - months) / 3;
+    tm.tm_year -= 1900;
+    return timegm(&tm);
+}
+
+/* If-None-Match 목록에 etag가 있는지 ("*"는 모두, W/는 약한 비교로 무시) */
+static int etag_match(const char *list, const char *etag) {
+    const char *p = list;
+    size_t n = strlen(etag);
+
+    while (*(p += strspn(p, " \t,"))) {
+        if (*p == '*')
+            return 1;
+        if (!strncmp(p, "W/", 2))
+            p += 2;
+        if (!strncmp(p, etag, n) && strchr(", \t", p[n]))
+            return 1;
+        p += strcspn(p, ",");
+    }
+    return 0;
+}
+
+/*
+ * [수정] 조건부 요청이 맞으면 304를 보내고 1. If-None-Match가 있으면
+ * If-Modified-Since는 보지 않는다. 조건부 헤더가 없으면 검증자도 만들지 않음
+ */
+static int serve_304(int fd, reqhdrs_t *hdrs, ino_t ino, off_t size,
+                     struct timespec mtime, const char *suffix, const char *filetype) {
+    validators_t v;
+    char buf[MAXBUF];
+    int n;
+
+    if (!hdrs->inm[0] && hdrs->ims == -1)
+        return 0;
+    make_validators(&v, ino, size, mtime, suffix);
+    if (hdrs->inm[0] ? !etag_match(hdrs->inm, v.etag) : mtime.tv_sec > hdrs->ims)
+        return 0;
+    n = snprintf(buf, sizeof(buf), "HTTP/1.0 304 Not Modified\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: close\r\n"
+                 "ETag: %s\r\n"
+                 "Last-Modified: %s\r\n%s\r\n", v.etag, v.lastmod,
+                 gz_compressible(filetype) ? "Vary: Accept-Encoding\r\n" : "");
+    if (verbose) {
+        printf("Response headers:\n");
+        printf("%s", buf);
+    }
+    rio_writen(fd, buf, n);
+    return 1;
+}
+
+/*
+ * [수정] Range 요청에 답한다. 본문은 mem (NULL이 아니면) 또는 srcfd.
+ * 1: 206/416을 보냈음, 0: Range를 무시해야 함 (형식 오류 등 - 전체를 보낼 것)
+ */
+static int serve_range(int fd, char *filename, char *method, char *spec,
+                       long size, char *mem, int srcfd) {
+    range_t r[RANGE_MAX];
+    char filetype[MAXLINE], buf[MAXBUF];
+    body_src_t src = { mem, srcfd };
+    int nr = range_parse(spec, size, r, RANGE_MAX), n;
+
+    if (nr == 0)
+        return 0;
+    if (nr < 0) {
+        n = range_416(buf, sizeof(buf), size);
+        rio_writen(fd, buf, n);
+        return 1;
+    }
     get_filetype(filename, filetype);
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");
-    sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-    sprintf(buf, "%sConnection: close\r\n", buf);
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
-    sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
-    Rio_writen(fd, buf, strlen(buf));
-    printf("Response headers:\n");
-    printf("%s", buf);
+    n = snprintf(buf, sizeof(buf), "HTTP/1.0 206 Partial Content\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: close\r\n"
+                 "Accept-Ranges: bytes\r\n%s",
+                 gz_compressible(filetype) ? "Vary: Accept-Encoding\r\n" : "");
+    n += range_headers(buf + n, sizeof(buf) - n, filetype, r, nr, size);
+    n += snprintf(buf + n, sizeof(buf) - n, "\r\n");
+    if (verbose) {
+        printf("Response headers:\n");
+        printf("%s", buf);
+    }
+    if (strcasecmp(method, "HEAD") == 0) {
+        rio_writen(fd, buf, n);
+        return 1;
+    }
+    if (send_more(fd, buf, n) == 0)
+        range_send_body(fd, filetype, r, nr, size, send_body, &src);
+    return 1;
+}
+
+/*
+ * [수정] 캐시 엔트리로 응답. 작은 파일은 헤더+본문을 write 한 번,
+ * 큰 파일은 헤더(MSG_MORE) + sendfile
+ */
+static void serve_cached(int fd, fc_entry_t *e, char *filename, char *method, reqhdrs_t *hdrs) {
+    char filetype[MAXLINE];
 
+    if (hdrs->inm[0] || hdrs->ims != -1) {
+        get_filetype(filename, filetype);
+        if (serve_304(fd, hdrs, e->ino, e->size, e->mtime, e->gz ? "-gz" : "", filetype))
+            return;
+    }
+    if (hdrs->range[0] && !e->gz &&
+        serve_range(fd, filename, method, hdrs->range, e->size,
+                    e->fd < 0 ? e->resp + e->hdrlen : NULL, e->fd))
+        return;
+    if (verbose) {
+        printf("Response headers:\n");
+        printf("%.*s", e->hdrlen, e->resp);
+    }
     if (strcasecmp(method, "HEAD") == 0)
+        rio_writen(fd, e->resp, e->hdrlen);
+    else if (e->fd < 0)
+        rio_writen(fd, e->resp, e->resplen);
+    else if (send_more(fd, e->resp, e->hdrlen) == 0)
+        send_file(fd, e->fd, 0, e->size);
+}
+
+/*
+ * [수정] gzip 응답: 원본보다 새 filename.gz 가 있으면 그 파일을, 없으면
+ * 즉석 압축 결과를. 0이면 압축하지 않음 (형식이 아니거나 너무 작거나 크거나
+ * 줄지 않음, 파일 없음) - 원본을 보낼 것.
+ * 고른 결과와 헤더는 fcache의 gzip 엔트리에 넣어 두고, 다음부터는
+ * stat/open 없이 그것으로 보낸다 (304 검사도 serve_cached가)
+ */
+static int serve_gzip(int fd, char *filename, char *method, reqhdrs_t *hdrs) {
+    char filetype[MAXLINE], gzname[MAXLINE], buf[MAXBUF];
+    struct stat sb, gsb, *vsb = &sb;
+    validators_t v;
+    fc_entry_t *fe;
+    gz_entry_t *e = NULL;
+    int srcfd = -1, n;
+    long len;
+
+    get_filetype(filename, filetype);
+    if (!gz_compressible(filetype))
+        return 0;
+    if ((fe = fcache_get_gz(filename)) != NULL) {
+        int gz = fe->gz;
+        if (gz)
+            serve_cached(fd, fe, filename, method, hdrs);
+        fcache_release(fe);
+        return gz;
+    }
+    if (stat(filename, &sb) < 0 || !S_ISREG(sb.st_mode) || !(S_IRUSR & sb.st_mode))
+        return 0;
+    if (snprintf(gzname, sizeof(gzname), "%s.gz", filename) < (int) sizeof(gzname) &&
+        stat(gzname, &gsb) == 0 && S_ISREG(gsb.st_mode) &&
+        (gsb.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+         (gsb.st_mtim.tv_sec == sb.st_mtim.tv_sec && gsb.st_mtim.tv_nsec >= sb.st_mtim.tv_nsec))) {
+        /* 미리 압축한 파일: 검증자도 그 파일의 stat으로 */
+        vsb = &gsb;
+        if (serve_304(fd, hdrs, gsb.st_ino, gsb.st_size, gsb.st_mtim, "-gz", filetype))
+            return 1;
+        if ((srcfd = open(gzname, O_RDONLY)) < 0)
+            return 0;
+        len = gsb.st_size;
+    } else if (sb.st_size >= GZ_MIN_SIZE && sb.st_size <= GZ_SRC_MAX &&
+               serve_304(fd, hdrs, sb.st_ino, sb.st_size, sb.st_mtim, "-gz", filetype)) {
+        return 1;               // 압축하지 않고 304 (fcache 엔트리가 없을 때 - -c mtime)
+    } else if ((e = gzcache_get(filename, &sb)) != NULL) {
+        len = e->len;
+    } else {
+        fcache_put_gz(filename, &sb, -1, NULL, NULL, 0, NULL, 0);
+        return 0;
+    }
+    make_validators(&v, vsb->st_ino, vsb->st_size, vsb->st_mtim, "-gz");
+
+    n = snprintf(buf, sizeof(buf), "HTTP/1.0 200 OK\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: close\r\n"
+                 "Content-Encoding: gzip\r\n"
+                 "Vary: Accept-Encoding\r\n"
+                 "ETag: %s\r\n"
+                 "Last-Modified: %s\r\n"
+                 "Content-length: %ld\r\n"
+                 "Content-type: %s\r\n\r\n", v.etag, v.lastmod, len, filetype);
+
+    /* 미리 압축한 파일의 fd는 fcache로 넘어간다 */
+    fe = fcache_put_gz(filename, &sb, srcfd, &gsb, e ? e->data : NULL, len, buf, n);
+    if (e)
+        gzcache_release(e);
+    serve_cached(fd, fe, filename, method, hdrs);
+    fcache_release(fe);
+    return 1;
+}
+
+/*
+ * [수정] Open은 fd가 모자라면 (EMFILE) 서버를 끝내므로 open으로 열고,
+ * 실패하면 500을 보낸다. 연 fd 또는 -1
+ */
+static int open_static(int fd, char *filename) {
+    int srcfd = open(filename, O_RDONLY);
+
+    if (srcfd < 0)
+        clienterror(fd, filename, "500", "Internal Server Error",
+                    "Tiny couldn't open the file");
+    return srcfd;
+}
+
+void serve_static(int fd, char *filename, struct stat *sbuf, char *method, reqhdrs_t *hdrs) {
+    int srcfd, filesize = sbuf->st_size, n;
+    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    int head = strcasecmp(method, "HEAD") == 0;
+    fc_entry_t *e;
+    validators_t v;
+
+    /* [수정] 조건부 요청이면 파일을 열기 전에 304 */
+    get_filetype(filename, filetype);
+    if (serve_304(fd, hdrs, sbuf->st_ino, sbuf->st_size, sbuf->st_mtim, "", filetype))
         return;
+    make_validators(&v, sbuf->st_ino, sbuf->st_size, sbuf->st_mtim, "");
+
+    /*
+     * Send response headers to client
+     * [수정] sprintf(buf, "%s...", buf) 는 읽는 곳과 쓰는 곳이 겹쳐서 (UB) 오프셋으로 이어 씀
+     */
+    n = snprintf(buf, sizeof(buf), "HTTP/1.0 200 OK\r\n");
+    n += snprintf(buf + n, sizeof(buf) - n, "Server: Tiny Web Server\r\n");
+    n += snprintf(buf + n, sizeof(buf) - n, "Connection: close\r\n");
+    n += snprintf(buf + n, sizeof(buf) - n, "Accept-Ranges: bytes\r\n");
+    if (gz_compressible(filetype))
+        n += snprintf(buf + n, sizeof(buf) - n, "Vary: Accept-Encoding\r\n");
+    n += snprintf(buf + n, sizeof(buf) - n, "ETag: %s\r\n", v.etag);
+    n += snprintf(buf + n, sizeof(buf) - n, "Last-Modified: %s\r\n", v.lastmod);
+    n += snprintf(buf + n, sizeof(buf) - n, "Content-length: %d\r\n", filesize);
+    n += snprintf(buf + n, sizeof(buf) - n, "Content-type: %s\r\n\r\n", filetype);
+
+    /* [수정] 캐시를 쓰면 열어 둔 파일과 만든 헤더를 넣고 그것으로 응답 */
+    if (fc_mode != FC_OFF) {
+        if ((srcfd = open_static(fd, filename)) < 0)
+            return;
+        e = fcache_put(filename, srcfd, sbuf, buf, strlen(buf));
+        serve_cached(fd, e, filename, method, hdrs);
+        fcache_release(e);
+        return;
+    }
+
+    /* [수정] Range: 매핑 (-m) 이나 fd에서 구간만 */
+    if (hdrs->range[0]) {
+        int done;
+        if ((srcfd = open_static(fd, filename)) < 0)
+            return;
+        srcp = use_mmap && filesize > 0 ? Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0) : NULL;
+        done = serve_range(fd, filename, method, hdrs->range, filesize, srcp, srcfd);
+        if (srcp)
+            Munmap(srcp, filesize);
+        Close(srcfd);
+        if (done)
+            return;
+    }
+
+    /* [수정] 본문 파일은 헤더를 보내기 전에 연다 (실패하면 아직 500을 보낼 수 있음) */
+    srcfd = -1;
+    if (!head && filesize > 0 && (srcfd = open_static(fd, filename)) < 0)
+        return;
+    if (use_mmap || srcfd < 0)
+        n = rio_writen(fd, buf, strlen(buf));
+    else
+        n = send_more(fd, buf, strlen(buf));
+    if (verbose) {
+        printf("Response headers:\n");
+        printf("%s", buf);
+    }
+
+    if (n < 0 || srcfd < 0) {   // 클라이언트가 끊음, 또는 보낼 본문이 없음
+        if (srcfd >= 0)
+            Close(srcfd);
+        return;
+    }
 
     /* Send response body to client */
-    srcfd = Open(filename, O_RDONLY, 0);
+    if (!use_mmap) {
+        send_file(fd, srcfd, 0, filesize);
+        Close(srcfd);
+        return;
+    }
     srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);
     Close(srcfd);
-    Rio_writen(fd, srcp, filesize);
+    rio_writen(fd, srcp, filesize);
     Munmap(srcp, filesize);
 
     /*homework_11.9*/
@@ -171,22 +789,57 @@ void get_filetype(char *filename, char *filetype) {
 
 void serve_dynamic(int fd, char *filename, char *cgiargs, char *method) {
     char buf[MAXLINE], *emptylist[] = {NULL};
+    pid_t pid;
 
     /* Return first part of HTTP response */
     sprintf(buf, "HTTP/1.0 200 OK\r\n");
-    Rio_writen(fd, buf, strlen(buf));
+    rio_writen(fd, buf, strlen(buf));
     sprintf(buf, "Server: Tiny Web Server\r\n");
-    Rio_writen(fd, buf, strlen(buf));
+    if (rio_writen(fd, buf, strlen(buf)) < 0)
+        return;     // 클라이언트가 끊음
+
+    /* [수정] 풀 워커가 있으면 클라이언트 소켓을 넘기고 끝 (응답은 워커가 직접 씀) */
+    if (cgipool_run(filename, fd, cgiargs, method) == 0)
+        return;
 
-    if (Fork() == 0) {
+    if ((pid = Fork()) == 0) {
         /* Child */
         /* Real server would set all CGI vars here */
         setenv("QUERY_STRING", cgiargs, 1);
         setenv("REQUEST_METHOD", method, 1); // "REQUEST_METHOD" 환경 변수에 주어진 메소드 설정
+        Signal(SIGPIPE, SIG_DFL); /* [수정] 무시 설정은 exec 뒤에도 남으므로 되돌림 */
         Dup2(fd, STDOUT_FILENO); /* Redirect stdout to client */
         Execve(filename, emptylist, environ); /* Run CGI program */
     }
-    Wait(NULL);
+    /* [수정] Wait(NULL)은 다른 워커가 띄운 자식을 거둘 수 있다 - 내 자식만 */
+    Waitpid(pid, NULL, 0);
+}
+
+/*
+ * [수정] .so 핸들러를 부른다. 핸들러가 상태 줄 바로 뒤에 쓰게 해서
+ * write 한 번으로 보낸다. 스택 버퍼에 안 들어가면 필요한 만큼 잡아 다시 부름
+ */
+static void serve_plugin(int fd, char *filename, struct stat *sbuf, char *cgiargs, char *method) {
+    static const char status[] = "HTTP/1.0 200 OK\r\nServer: Tiny Web Server\r\n";
+    char stackbuf[MAXBUF], *buf = stackbuf;
+    size_t hl = sizeof(status) - 1, cap = sizeof(stackbuf);
+    int n;
+
+    memcpy(buf, status, hl);
+    n = plugin_run(filename, sbuf, method, cgiargs, buf + hl, cap - hl);
+    if (n > (int) (cap - hl) && n <= PLUGIN_RESP_MAX) {
+        cap = hl + n;
+        buf = Malloc(cap);
+        memcpy(buf, status, hl);
+        n = plugin_run(filename, sbuf, method, cgiargs, buf + hl, cap - hl);
+    }
+    if (n < 0 || n > (int) (cap - hl))
+        clienterror(fd, filename, "500", "Internal Server Error",
+                    "Tiny couldn't run the handler");
+    else
+        rio_writen(fd, buf, hl + n);
+    if (buf != stackbuf)
+        Free(buf);
 }
 
 void clienterror(int fd, char *cause, char *errnum,
@@ -201,22 +854,40 @@ void clienterror(int fd, char *cause, char *errnum,
     sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
 
     /* Print the HTTP response */
+    /* [수정] 클라이언트가 끊었어도 tiny는 계속 (Rio_writen은 exit) */
     sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
+    rio_writen(fd, buf, strlen(buf));
     sprintf(buf, "Content-type: text/html\r\n");
-    Rio_writen(fd, buf, strlen(buf));
+    rio_writen(fd, buf, strlen(buf));
     sprintf(buf, "Content-length: %d\r\n\r\n", (int) strlen(body));
-    Rio_writen(fd, buf, strlen(buf));
-    Rio_writen(fd, body, strlen(body));
+    rio_writen(fd, buf, strlen(buf));
+    rio_writen(fd, body, strlen(body));
 }
 
-void read_requesthdrs(rio_t *rp) {
+void read_requesthdrs(rio_t *rp, reqhdrs_t *hdrs) {
     char buf[MAXLINE];
+    const char *v;
 
-    Rio_readlineb(rp, buf, MAXLINE);
+    hdrs->range[0] = '\0';
+    hdrs->gzip = 0;
+    hdrs->inm[0] = '\0';
+    hdrs->ims = -1;
+    if (rio_readlineb(rp, buf, MAXLINE) <= 0)
+        return;         // [수정] 끊기면 거기까지가 헤더
     while (strcmp(buf, "\r\n")) {
-        Rio_readlineb(rp, buf, MAXLINE);
-        printf("%s", buf);
+        /* [수정] 쓰는 헤더만 골라 둔다 (값은 줄 끝의 \r\n 앞까지) */
+        if ((v = range_find(buf)) != NULL)
+            snprintf(hdrs->range, sizeof(hdrs->range), "%.*s", (int) strcspn(v, "\r\n"), v);
+        else if (!strncasecmp(buf, "Accept-Encoding:", 16))
+            hdrs->gzip = gz_accepts(buf + 16);
+        else if (!strncasecmp(buf, "If-None-Match:", 14))
+            snprintf(hdrs->inm, sizeof(hdrs->inm), "%.*s", (int) strcspn(buf + 14, "\r\n"), buf + 14);
+        else if (!strncasecmp(buf, "If-Modified-Since:", 18))
+            hdrs->ims = parse_http_date(buf + 18);
+        if (rio_readlineb(rp, buf, MAXLINE) <= 0)
+            break;
+        if (verbose)
+            printf("%s", buf);
     }
     return;
 }
@@ -0,0 +1,156 @@
+/*
+ * trace.c - 스레드별 링 버퍼에 쌓는 연결 수명 이벤트
+ *
+ * p99가 튈 때 시간이 sbuf 대기, DNS/connect, 원 서버, 클라이언트 쓰기 중
+ * 어디서 갔는지 보려고 연결마다 주요 시점을 남긴다. 연결은 fd가 아니라
+ * 수락할 때 붙인 id로 구분한다 (fd는 닫히면 재사용됨).
+ *
+ * 링은 log.c처럼 스레드마다 하나이고 끝난 스레드의 링은 다음 스레드가
+ * 물려받는다. 코루틴은 trace_record 안에서 양보하지 않으므로 생산자는
+ * 항상 하나다. 덤프는 링을 복사한 뒤 head를 다시 읽어 복사하는 동안
+ * 덮어써졌을 수 있는 칸을 버린다.
+ */
+#include "trace.h"
+#include <sys/resource.h>
+
+#define TRACE_SLOTS 8192        /* 스레드 링의 이벤트 수 (2의 거듭제곱) */
+
+typedef struct {
+    long ts;                    /* CLOCK_MONOTONIC ns */
+    unsigned id;                /* 연결 id (0: 모름) */
+    unsigned ev;                /* trace_ev_t */
+} trace_rec_t;
+
+typedef struct trace_ring {
+    trace_rec_t recs[TRACE_SLOTS];
+    unsigned long head;         /* 다음에 쓸 위치 (계속 증가) */
+    int idx;                    /* JSON의 tid */
+    struct trace_ring *next;
+    struct trace_ring *next_idle;
+} trace_ring_t;
+
+int trace_on;
+
+static unsigned *conn_id;       /* conn_id[fd]: 열려 있는 연결의 id */
+static int fd_max;
+static unsigned next_id;
+
+static trace_ring_t *all_rings, *idle_rings;
+static int nrings;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static __thread trace_ring_t *my_ring;
+
+static const char *ev_names[TR_NEVENTS] = {
+    [TR_ACCEPT]     = "accept",
+    [TR_DEQUEUE]    = "dequeue",
+    [TR_PARSED]     = "parsed",
+    [TR_CACHE_HIT]  = "cache_hit",
+    [TR_CACHE_MISS] = "cache_miss",
+    [TR_CONNECTED]  = "connected",
+    [TR_FIRST_BYTE] = "first_byte",
+    [TR_DONE]       = "done",
+};
+
+static void ring_exit(void *arg)
+{
+    trace_ring_t *r = arg;
+
+    my_ring = NULL;
+    pthread_mutex_lock(&ring_lock);
+    r->next_idle = idle_rings;
+    idle_rings = r;
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static trace_ring_t *get_ring(void)
+{
+    trace_ring_t *r;
+
+    if ((r = my_ring))
+        return r;
+    pthread_mutex_lock(&ring_lock);
+    if ((r = idle_rings)) {
+        idle_rings = r->next_idle;
+    } else {
+        r = Calloc(1, sizeof(trace_ring_t));
+        r->idx = ++nrings;
+        r->next = all_rings;
+        __atomic_store_n(&all_rings, r, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&ring_lock);
+    pthread_setspecific(ring_key, r);
+    return my_ring = r;
+}
+
+void trace_init(void)
+{
+    struct rlimit rl;
+
+    fd_max = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+             ? rl.rlim_cur : 65536;
+    conn_id = Calloc(fd_max, sizeof(unsigned));
+    pthread_key_create(&ring_key, ring_exit);
+    trace_on = 1;
+}
+
+void trace_record(int fd, trace_ev_t ev)
+{
+    trace_ring_t *r = get_ring();
+    unsigned long h = r->head;
+    trace_rec_t *rec = &r->recs[h & (TRACE_SLOTS - 1)];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec->ts = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    rec->id = fd < fd_max ? __atomic_load_n(&conn_id[fd], __ATOMIC_RELAXED) : 0;
+    rec->ev = ev;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+void trace_accept(int fd)
+{
+    if (!trace_on)
+        return;
+    /* id는 main(수락 스레드)만 붙이고, sbuf를 지나며 워커에 보인다 */
+    if (fd < fd_max)
+        __atomic_store_n(&conn_id[fd], ++next_id, __ATOMIC_RELAXED);
+    trace_record(fd, TR_ACCEPT);
+}
+
+/*
+ * 연결마다 accept~done을 비동기 구간(b/e)으로, 나머지는 그 안의
+ * 순간 이벤트(n)로 낸다. tid는 기록한 스레드 (링 번호).
+ */
+void trace_dump(FILE *fp)
+{
+    trace_rec_t *copy = Malloc(sizeof(trace_rec_t) * TRACE_SLOTS);
+    const char *sep = "";
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (trace_ring_t *r = __atomic_load_n(&all_rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        unsigned long end = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned long start = end > TRACE_SLOTS ? end - TRACE_SLOTS : 0;
+
+        for (unsigned long i = start; i < end; i++)
+            copy[i - start] = r->recs[i & (TRACE_SLOTS - 1)];
+        /* 복사하는 동안 생산자가 덮어썼을 수 있는 앞부분은 버림 */
+        unsigned long now = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned long valid = now > TRACE_SLOTS ? now - TRACE_SLOTS : 0;
+
+        for (unsigned long i = start > valid ? start : valid; i < end; i++) {
+            trace_rec_t *e = &copy[i - start];
+            const char *ph = e->ev == TR_ACCEPT ? "b" : e->ev == TR_DONE ? "e" : "n";
+
+            if (e->id == 0 || e->ev >= TR_NEVENTS)
+                continue;
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"conn\",\"ph\":\"%s\","
+                    "\"id\":%u,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+                    sep, e->ev == TR_ACCEPT || e->ev == TR_DONE ? "conn" : ev_names[e->ev],
+                    ph, e->id, r->idx, e->ts / 1000.0);
+            sep = ",";
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    Free(copy);
+}
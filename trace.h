@@ -0,0 +1,45 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "csapp.h"
+
+/*
+ * 연결 수명 추적. 각 스레드는 자기 링(단일 생산자, 락 없음)에 16바이트
+ * 이벤트를 쓰고, 링이 돌면 가장 오래된 것부터 덮어쓴다 (최근 기록만 남는
+ * 비행 기록기). trace_dump가 모든 링을 Chrome trace JSON으로 내보낸다
+ * (chrome://tracing, ui.perfetto.dev에서 열림).
+ *
+ * 꺼져 있으면 (기본) trace_ev는 전역 변수 하나를 읽고 끝난다.
+ */
+typedef enum {
+    TR_ACCEPT,          /* 입장 검사를 통과 (연결 id를 붙임) */
+    TR_DEQUEUE,         /* 워커/코루틴이 연결을 잡음 */
+    TR_PARSED,          /* 요청 라인 파싱 끝 */
+    TR_CACHE_HIT,
+    TR_CACHE_MISS,
+    TR_CONNECTED,       /* 원 서버 연결 (DNS 포함) 끝 */
+    TR_FIRST_BYTE,      /* 원 서버 응답의 첫 조각 */
+    TR_DONE,            /* 연결 닫음 */
+    TR_NEVENTS
+} trace_ev_t;
+
+extern int trace_on;
+
+/* 추적을 켠다 (다른 스레드를 만들기 전에 호출) */
+void trace_init(void);
+
+/* 새 연결에 id를 붙이고 TR_ACCEPT 기록 */
+void trace_accept(int fd);
+
+void trace_record(int fd, trace_ev_t ev);
+
+static inline void trace_ev(int fd, trace_ev_t ev)
+{
+    if (trace_on)
+        trace_record(fd, ev);
+}
+
+/* 모든 링의 이벤트를 Chrome trace JSON으로 */
+void trace_dump(FILE *fp);
+
+#endif /* __TRACE_H__ */